@@ -1,331 +1,701 @@
 #include "json.hpp"
+#include "json_detail.hpp"
 #include <algorithm>
-#include <iomanip>
-#include <iostream>
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
 #include <limits>
 #include <memory>
 
-inline void skipSpaces(std::string_view::const_iterator &p,
-                       const std::string_view::const_iterator &end) {
-  while (p != end && std::isspace(*p)) {
-    p++;
+Json::Arena::~Arena() {
+  while (head) {
+    auto next = head->next;
+    std::free(head);
+    head = next;
   }
 }
 
-inline std::string readUntil(std::string_view::const_iterator &p,
-                             const std::string_view::const_iterator &end, char ch) {
-  std::string buff;
-  while (p != end && *p != ch) {
-    if ((*p == '\\') && (p + 1 != end)) {
-      buff += "\\";
-      buff += *(p + 1);
-      p += 2;
-    } else {
-      buff += *p;
-      p++;
+void *Json::Arena::do_allocate(size_t bytes, size_t align) {
+  constexpr size_t minChunk = 4096;
+  constexpr size_t maxChunk = 16 << 20;
+  auto aligned = [align](char *ptr) {
+    return reinterpret_cast<char *>((reinterpret_cast<uintptr_t>(ptr) + align - 1) & ~(align - 1));
+  };
+  char *ptr = aligned(cur);
+  if (!cur || ptr + bytes > limit) {
+    // Each chunk is as large as everything allocated so far, capped so a
+    // huge document does not overshoot by more than one cap's worth.
+    size_t size = std::min(std::max(minChunk, reserved), maxChunk);
+    size = std::max(size, sizeof(Chunk) + bytes + align);
+    auto chunk = static_cast<Chunk *>(std::malloc(size));
+    if (!chunk) {
+      throw std::bad_alloc();
     }
+    chunk->next = head;
+    head = chunk;
+    count += 1;
+    reserved += size;
+    cur = reinterpret_cast<char *>(chunk + 1);
+    limit = reinterpret_cast<char *>(chunk) + size;
+    ptr = aligned(cur);
   }
-  return buff;
+  cur = ptr + bytes;
+  return ptr;
 }
 
-std::pair<Json::JsonValue, size_t> Json::parse(const std::string_view &buff) {
-  if (buff.empty()) {
-    return {nullptr, 0};
+std::string_view Json::Arena::store(std::string_view text) {
+  if (text.empty()) {
+    return std::string_view();
   }
+  auto data = static_cast<char *>(allocate(text.size(), 1));
+  std::memcpy(data, text.data(), text.size());
+  return std::string_view(data, text.size());
+}
 
-  const auto begin = buff.begin();
-  const auto end = buff.end();
-  auto p = buff.begin();
-  skipSpaces(p, end);
+namespace {
 
-  if (*p == '"') { // ---------- for JsonString
-    p += 1; // "
-    auto str = readUntil(p, end, '"');
-    p += 1; // "
-    skipSpaces(p, end);
-    return {
-        std::make_shared<JsonString>(str),
-        p - begin,
-    };
-  } else if (*p == '\'') { // ---------- for JsonString
-    p += 1; // '
-    auto str = readUntil(p, end, '\'');
-    p += 1; // '
-    skipSpaces(p, end);
-    return {
-        std::make_shared<JsonString>(str),
-        p - begin,
-    };
-  } else if (std::isdigit(*p) || *p == '.' || *p == '-') { // ---------- for JsonNumber
-    char* pos = 0;
-    const char* start = &(*p);
-    auto v = std::strtod(start, &pos); // strtod performs better than stod
-    if (0 == pos - start) {
-      throw "invalid number";
+// Cheap hash for object keys, which are mostly short: mixes the length with
+// the first and last eight bytes, leaving any middle bytes to the compare.
+size_t keyHash(std::string_view key) {
+  uint64_t head = 0;
+  uint64_t tail = 0;
+  if (key.size() >= 8) {
+    std::memcpy(&head, key.data(), 8);
+    std::memcpy(&tail, key.data() + key.size() - 8, 8);
+  } else {
+    for (auto ch : key) {
+      head = (head << 8) | static_cast<unsigned char>(ch);
     }
-    p += (pos - start);
-    skipSpaces(p, end);
-    auto parsed = std::string_view(start, pos - start);
-    if (parsed.find('.') == std::string_view::npos) {
-      auto v = std::strtol(start, nullptr, 10);
-      return {
-        std::make_shared<JsonNumber>(v),
-        p - begin,
-      };
-    }
-    return {
-      std::make_shared<JsonNumber>(v),
-      p - begin,
-    };
-  } else if (std::string(p, p + 4) == "true") { // ---------- for JsonBoolean
-    p += 4;
-    skipSpaces(p, end);
-    return {
-        std::make_shared<JsonBoolean>(true),
-        p - begin,
-    };
-  } else if (std::string(p, p + 5) == "false") { // ---------- for JsonBoolean
-    p += 5;
-    skipSpaces(p, end);
-    return {
-        std::make_shared<JsonBoolean>(false),
-        p - begin,
-    };
-  } else if (std::string(p, p + 4) == "null") { // ---------- for JsonObject
-    p += 4;
-    skipSpaces(p, end);
-    return {
-        std::make_shared<JsonObject>(true),
-        p - begin,
-    };
-  } else if (*p == '{') { // ---------- for JsonObject
-    p += 1; // {
-    skipSpaces(p, end);
+  }
+  uint64_t h = head ^ (tail * 0x9e3779b97f4a7c15ULL) ^ key.size();
+  h = (h ^ (h >> 33)) * 0xff51afd7ed558ccdULL;
+  h = (h ^ (h >> 33)) * 0xc4ceb9fe1a85ec53ULL;
+  return static_cast<size_t>(h ^ (h >> 33));
+}
 
-    auto obj = std::make_shared<JsonObject>();
+} // namespace
 
-    while (true) {
-      if (*p == '"') {
-        p += 1; // "
-        auto key = readUntil(p, end, '"');
-        p += 1; // "
-        skipSpaces(p, end);
-        if (*p != ':') {
-          throw "syntax error: colon expected";
-        }
-        p += 1; // :
-        skipSpaces(p, end);
-        auto [val, sz] = parse(std::string_view(&(*p), end - p));
-        obj->pairs[key] = val;
-        p += sz;
-        skipSpaces(p, end);
-        if (*p == ',') {
-          p += 1; // ,
-        }
-        skipSpaces(p, end);
-      } else if (*p != '}') {
-        auto key = readUntil(p, end, ':');
-        p += 1; // :
-        skipSpaces(p, end);
-        auto [val, sz] = parse(std::string_view(&(*p), end - p));
-        obj->pairs[key] = val;
-        p += sz;
-        skipSpaces(p, end);
-        if (*p == ',') {
-          p += 1; // ,
-        }
-        skipSpaces(p, end);
-      } else {
-        break;
-      }
+size_t Json::KeyTable::probe(std::string_view key) const {
+  auto mask = slots.size() - 1;
+  auto slot = keyHash(key) & mask;
+  while (!slots[slot].empty() && slots[slot] != key) {
+    slot = (slot + 1) & mask;
+  }
+  return slot;
+}
+
+void Json::KeyTable::grow() {
+  std::vector<std::string_view> old(std::max<size_t>(64, slots.size() * 2));
+  old.swap(slots);
+  for (auto key : old) {
+    if (!key.empty()) {
+      slots[probe(key)] = key;
     }
+  }
+}
 
-    p += 1; // }
-    skipSpaces(p, end);
-    return {obj, p - begin};
-  } else if (*p == '[') { // ---------- for JsonArray
-    p += 1; // [
-    skipSpaces(p, end);
+std::string_view Json::KeyTable::intern(std::string_view key, bool borrowed) {
+  if (key.empty()) {
+    hasEmpty = true;
+    return std::string_view();
+  }
+  // Keep the table at most half full.
+  if ((count + 1) * 2 > slots.size()) {
+    grow();
+  }
+  auto &slot = slots[probe(key)];
+  if (slot.empty()) {
+    slot = borrowed ? key : arena->store(key);
+    count += 1;
+  }
+  return slot;
+}
 
-    auto arr = std::make_shared<JsonArray>();
+std::optional<std::string_view> Json::KeyTable::find(std::string_view key) const {
+  if (key.empty()) {
+    return hasEmpty ? std::optional<std::string_view>(std::string_view()) : std::nullopt;
+  }
+  if (slots.empty()) {
+    return std::nullopt;
+  }
+  auto &slot = slots[probe(key)];
+  return slot.empty() ? std::nullopt : std::optional<std::string_view>(slot);
+}
 
-    while (*p != ']') {
-      auto [val, sz] = parse(std::string_view(&(*p), end - p));
-      arr->values.push_back(val);
-      p += sz;
-      skipSpaces(p, end);
-      if (*p == ',') {
-        p += 1; // ,
+Json::JsonValue::JsonValue(std::string_view value) : tag_(Tag::String), chars_(value.data()) {
+  if (value.size() > std::numeric_limits<uint32_t>::max()) {
+    throw "string too large";
+  }
+  size_ = static_cast<uint32_t>(value.size());
+}
+
+Json::NumberKind Json::JsonValue::numKind() const {
+  switch (tag_) {
+  case Tag::Integer: return NumberKind::Integer;
+  case Tag::Floating: return NumberKind::Floating;
+  default: throw "type error: number";
+  }
+}
+
+bool Json::JsonValue::asBool() const {
+  if (!isBoolean()) {
+    throw "type error: boolean";
+  }
+  return tag_ == Tag::True;
+}
+
+long Json::JsonValue::asInteger() const {
+  if (tag_ != Tag::Integer) {
+    throw "type error: integer";
+  }
+  return integer_;
+}
+
+double Json::JsonValue::asFloating() const {
+  return numKind() == NumberKind::Integer ? static_cast<double>(integer_) : floating_;
+}
+
+std::string_view Json::JsonValue::asString() const {
+  if (tag_ != Tag::String) {
+    throw "type error: string";
+  }
+  return std::string_view(chars_, size_);
+}
+
+long Json::JsonObject::lookup(std::string_view key) const {
+  if (pairs.size() <= indexThreshold) {
+    for (size_t i = 0; i < pairs.size(); i++) {
+      auto &name = pairs[i].first;
+      // Interned keys match on the pointer alone.
+      if (name.size() == key.size() && (name.data() == key.data() || name == key)) {
+        return i;
       }
-      skipSpaces(p, end);
     }
+    return -1;
+  }
+  if (indexed != pairs.size()) {
+    rebuildIndex();
+  }
+  for (auto slot = std::hash<std::string_view>()(key) & indexMask;; slot = (slot + 1) & indexMask) {
+    if (!index[slot]) {
+      return -1;
+    }
+    if (pairs[index[slot] - 1].first == key) {
+      return index[slot] - 1;
+    }
+  }
+}
 
-    p += 1; // ]
-    skipSpaces(p, end);
-    return {arr, p - begin};
+void Json::JsonObject::rebuildIndex() const {
+  auto size = static_cast<uint32_t>(pairs.size());
+  if (size * 2 > indexMask + 1) {
+    // Keep the table at most half full.
+    uint32_t slots = 64;
+    while (slots < size * 2) {
+      slots *= 2;
+    }
+    auto resource = pairs.get_allocator().resource();
+    index = static_cast<uint32_t *>(resource->allocate(slots * sizeof(uint32_t), alignof(uint32_t)));
+    indexMask = slots - 1;
+    indexed = 0;
+    std::memset(index, 0, slots * sizeof(uint32_t));
   }
+  for (; indexed < size; indexed++) {
+    auto slot = std::hash<std::string_view>()(pairs[indexed].first) & indexMask;
+    while (index[slot]) {
+      slot = (slot + 1) & indexMask;
+    }
+    index[slot] = indexed + 1;
+  }
+}
 
-  return {nullptr, 0};
+Json::JsonValue Json::JsonObject::find(std::string_view key) const {
+  auto pos = lookup(key);
+  return pos < 0 ? nullptr : pairs[pos].second;
 }
 
-#if 0
-std::string_view spaces(int indent) {
-  static std::string buff(8, ' ');
-  if (indent > buff.size()) {
-    buff.resize(2 * buff.size(), ' ');
-    return spaces(indent);
+void Json::JsonObject::set(std::string_view key, JsonValue value) {
+  auto pos = lookup(key);
+  if (pos >= 0) {
+    pairs[pos].second = value;
+  } else {
+    pairs.emplace_back(key, value);
   }
-  return std::string_view(buff.c_str(), std::max(0, indent));
 }
 
-void Json::print(Json::JsonValue value, int indent, bool narrow) {
-  if (!value) {
-    std::cout << "undefined";
+void Json::JsonArray::assign(const JsonValue *first, const JsonValue *last, bool packNumbers) {
+  auto count = static_cast<size_t>(last - first);
+  auto arena = values.get_allocator().resource();
+  if (packNumbers && count != 0) {
+    if (std::all_of(first, last, [](auto &v) { return v.isInteger(); })) {
+      auto data = static_cast<long *>(arena->allocate(count * sizeof(long), alignof(long)));
+      std::transform(first, last, data, [](auto &v) { return v.asInteger(); });
+      pack(data, count);
+      return;
+    }
+    if (std::all_of(first, last, [](auto &v) { return v.isFloating(); })) {
+      auto data = static_cast<double *>(arena->allocate(count * sizeof(double), alignof(double)));
+      std::transform(first, last, data, [](auto &v) { return v.asFloating(); });
+      pack(data, count);
+      return;
+    }
+  }
+  packing_ = Packing::None;
+  values.assign(first, last);
+}
+
+void Json::JsonArray::push_back(JsonValue value) {
+  unpack();
+  values.push_back(value);
+}
+
+void Json::JsonArray::set(size_t i, JsonValue value) {
+  unpack();
+  values[i] = value;
+}
+
+void Json::JsonArray::unpack() {
+  if (packing_ == Packing::None) {
     return;
   }
-  if (value->type == "string") {
-    if (auto p = std::dynamic_pointer_cast<JsonString>(value)) {
-      std::cout << (narrow ? "" : spaces(indent)) << "\"" << p->value << "\"";
-    } else {
-      throw "type error: string";
+  values.reserve(count_);
+  for (size_t i = 0; i < count_; i++) {
+    values.push_back((*this)[i]);
+  }
+  packing_ = Packing::None;
+}
+
+namespace {
+
+// Single pass over one cursor, reporting values to `handler` as they are
+// read. Open containers live on an explicit stack rather than the call
+// stack, so nesting depth costs no native stack and is capped at `maxDepth`.
+// Each step expects leading spaces to be skipped already and leaves the
+// cursor past the trailing spaces of what it consumed.
+template <typename Handler> struct Parser {
+  struct Frame {
+    bool object;
+    size_t count;
+  };
+
+  Parser(std::string_view buff, Handler &handler, size_t maxDepth)
+      : p(buff.data()), end(buff.data() + buff.size()), handler(handler), maxDepth(maxDepth) {
+    frames.reserve(std::min<size_t>(maxDepth, 64));
+  }
+
+  const char *p;
+  const char *end;
+  Handler &handler;
+  size_t maxDepth;
+  std::vector<Frame> frames;
+  // Decoding buffer for strings that contain escapes.
+  std::string scratch;
+
+  char peek() const { return p != end ? *p : '\0'; }
+
+  void expect(char ch, const char *error) {
+    if (peek() != ch) {
+      throw error;
     }
-  } else if (value->type == "number") {
-    if (auto p = std::dynamic_pointer_cast<JsonNumber>(value)) {
-      if (p->numType == "integer") {
-        std::cout << (narrow ? "" : spaces(indent)) << std::fixed << p->value.integer;
-      } else if (p->numType == "floating") {
-        static const auto pre = std::numeric_limits<double>::digits10 + 1;
-        std::cout << (narrow ? "" : spaces(indent)) << std::defaultfloat << std::setprecision(pre) << p->value.floating;
-      } else {
-        throw "invalid number type";
-      }
-    } else {
-      throw "type error: number";
+    p += 1;
+    skipSpaces(p, end);
+  }
+
+  // Steps over an optional comma after an element.
+  void separator() {
+    if (peek() == ',') {
+      p += 1;
+      skipSpaces(p, end);
+    }
+  }
+
+  std::string_view parseQuoted(char quote) {
+    p += 1; // opening quote
+    auto str = readString(p, end, quote, scratch);
+    skipSpaces(p, end);
+    return str;
+  }
+
+  // Lenient unquoted key: everything up to the next structural character,
+  // minus trailing spaces.
+  std::string_view parseBareKey() {
+    auto start = p;
+    p = simd::findStructural(p, end);
+    auto last = p;
+    while (last != start && simd::isSpace(*(last - 1))) {
+      last--;
+    }
+    return std::string_view(start, last - start);
+  }
+
+  void open(bool object) {
+    if (frames.size() == maxDepth) {
+      throw "syntax error: nesting too deep";
     }
-  } else if (value->type == "boolean") {
-    if (auto p = std::dynamic_pointer_cast<JsonBoolean>(value)) {
-      std::cout << (narrow ? "" : spaces(indent))
-                << (p->value ? "true" : "false");
+    p += 1; // { or [
+    skipSpaces(p, end);
+    if (object) {
+      handler.onStartObject();
     } else {
-      throw "type error: boolean";
+      handler.onStartArray();
     }
-  } else if (value->type == "object") {
-    if (auto p = std::dynamic_pointer_cast<JsonObject>(value)) {
-      if (p->isNull) {
-        std::cout << (narrow ? "" : spaces(indent)) << "null";
-      } else if (p->pairs.size() == 0) {
-        std::cout << (narrow ? "" : spaces(indent)) << "{}";
-      } else {
-        std::cout << (narrow ? "" : spaces(indent)) << "{" << std::endl;
-        std::vector<std::string> keys(p->pairs.size());
-        std::transform(p->pairs.begin(), p->pairs.end(), keys.begin(), [](auto& pair) { return pair.first; });
-        std::sort(keys.begin(), keys.end());
-        for (auto &key : keys) {
-          std::cout << spaces(indent + 2) << "\"" << key << "\"" << ": ";
-          print(p->pairs[key], indent + 2, true);
-          if (key != keys.back()) {
-            std::cout << ",";
-          }
-          std::cout << std::endl;
+    frames.push_back({object, 0});
+  }
+
+  // False, with nothing consumed, when the input does not start with a value.
+  bool parseValue();
+  // False, with nothing consumed, when there is no scalar at p.
+  bool parseScalar();
+};
+
+template <typename Handler> bool Parser<Handler>::parseValue() {
+  // Each round reads one value, then closes every container that ends right
+  // after it and reads the key of the next pair. Commas between elements are
+  // optional.
+  while (true) {
+    switch (peek()) {
+    case '{': // ---------- for JsonObject
+      open(true);
+      break;
+    case '[': // ---------- for JsonArray
+      open(false);
+      break;
+    default:
+      if (!parseScalar()) {
+        if (frames.empty()) {
+          return false;
         }
-        std::cout << spaces(indent) << "}";
+        throw p == end && !frames.back().object ? "syntax error: unexpected end of input"
+                                                : "syntax error: value expected";
       }
-    } else {
-      throw "type error: object";
+      if (frames.empty()) {
+        return true;
+      }
+      frames.back().count++;
+      separator();
     }
-  } else if (value->type == "array") {
-    if (auto p = std::dynamic_pointer_cast<JsonArray>(value)) {
-      if (p->values.size() == 0) {
-        std::cout << (narrow ? "" : spaces(indent)) << "[]";
+
+    while (true) {
+      auto &frame = frames.back();
+      if (peek() != (frame.object ? '}' : ']')) {
+        break;
+      }
+      p += 1; // } or ]
+      skipSpaces(p, end);
+      auto count = frame.count;
+      auto object = frame.object;
+      frames.pop_back();
+      if (object) {
+        handler.onEndObject(count);
       } else {
-        std::cout << (narrow ? "" : spaces(indent)) << "[" << std::endl;
-        for (auto &v : p->values) {
-          print(v, indent + 2);
-          if (v != p->values.back()) {
-            std::cout << ",";
-          }
-          std::cout << std::endl;
-        }
-        std::cout << spaces(indent) << "]";
+        handler.onEndArray(count);
       }
-    } else {
-      throw "type error: array";
+      if (frames.empty()) {
+        return true;
+      }
+      frames.back().count++;
+      separator();
+    }
+
+    if (frames.back().object) {
+      if (p == end) {
+        throw "syntax error: unexpected end of input";
+      }
+      // The handler takes its copy now; parsing the value may reuse the
+      // scratch buffer an escaped key was decoded into.
+      handler.onKey((*p == '"') ? parseQuoted('"') : parseBareKey());
+      expect(':', "syntax error: colon expected");
     }
   }
 }
-#else
-void Json::print(Json::JsonValue value, int indent, bool narrow) {
-  static const char* spaces = "                                ";
-  if (!value) {
-    printf("undefined");
-    return;
+
+template <typename Handler> bool Parser<Handler>::parseScalar() {
+  if (p == end) {
+    return false;
   }
-  if (value->type == "string") {
-    if (auto p = std::dynamic_pointer_cast<JsonString>(value)) {
-      printf("%.*s\"%s\"", narrow ? 0 : indent, spaces, p->value.c_str());
-    } else {
-      throw "type error: string";
+
+  switch (*p) {
+  case '"': case '\'': // ---------- for strings
+    handler.onString(parseQuoted(*p));
+    return true;
+  case '-': case '.':
+  case '0': case '1': case '2': case '3': case '4':
+  case '5': case '6': case '7': case '8': case '9': { // ---------- for numbers
+    auto num = readNumber(p, end);
+    skipSpaces(p, end);
+    emitNumber(handler, num);
+    return true;
+  }
+  case 't': // ---------- for booleans
+    if (matchLiteral(p, end, "true")) {
+      handler.onBool(true);
+      return true;
     }
-  } else if (value->type == "number") {
-    if (auto p = std::dynamic_pointer_cast<JsonNumber>(value)) {
-      if (p->numType == "integer") {
-        printf("%.*s%ld", narrow ? 0 : indent, spaces, p->value.integer);
-      } else if (p->numType == "floating") {
-        printf("%.*s%.16g", narrow ? 0 : indent, spaces, p->value.floating);
-      } else {
-        throw "invalid number type";
-      }
-    } else {
-      throw "type error: number";
+    break;
+  case 'f': // ---------- for booleans
+    if (matchLiteral(p, end, "false")) {
+      handler.onBool(false);
+      return true;
     }
-  } else if (value->type == "boolean") {
-    if (auto p = std::dynamic_pointer_cast<JsonBoolean>(value)) {
-      printf("%.*s%s", narrow ? 0 : indent, spaces, p->value ? "true" : "false");
-    } else {
-      throw "type error: boolean";
+    break;
+  case 'n': // ---------- for null
+    if (matchLiteral(p, end, "null")) {
+      handler.onNull();
+      return true;
     }
-  } else if (value->type == "object") {
-    if (auto p = std::dynamic_pointer_cast<JsonObject>(value)) {
-      if (p->isNull) {
-        printf("%.*snull", narrow ? 0 : indent, spaces);
-      } else if (p->pairs.size() == 0) {
-        printf("%.*s{}", narrow ? 0 : indent, spaces);
-      } else {
-        printf("%.*s{\n", narrow ? 0 : indent, spaces);
-        std::vector<std::string> keys(p->pairs.size());
-        std::transform(p->pairs.begin(), p->pairs.end(), keys.begin(), [](auto& pair) { return pair.first; });
-        std::sort(keys.begin(), keys.end());
-        for (auto &key : keys) {
-          printf("%.*s\"%s\": ", indent + 2, spaces, key.c_str());
-          print(p->pairs[key], indent + 2, true);
-          if (key != keys.back()) {
-            printf(",");
-          }
-          printf("\n");
-        }
-        printf("%.*s}", indent, spaces);
+    break;
+  }
+
+  return false;
+}
+
+// Runs the single-pass parser over `buff`; returns the offset just past the
+// root value and its trailing spaces, or 0 when there is no value.
+template <typename Handler> size_t parseWith(Handler &handler, std::string_view buff, size_t maxDepth) {
+  Parser<Handler> parser(buff, handler, maxDepth);
+  skipSpaces(parser.p, parser.end);
+  if (!parser.parseValue()) {
+    return 0;
+  }
+  return static_cast<size_t>(parser.p - buff.data());
+}
+
+} // namespace
+
+std::pair<Json::JsonValue, size_t> Json::parse(Document &doc, const std::string_view &buff,
+                                               const ParseOptions &options) {
+  if (options.threads != 1) {
+    auto result = parseArrayParallel(doc, buff, options);
+    if (result.first) {
+      return result;
+    }
+  }
+  if (options.engine == Engine::TwoStage) {
+    return parseTwoStage(doc, buff, options);
+  }
+  DomBuilder builder(*doc.arena, options.borrowStrings ? buff : std::string_view(),
+                     options.internKeys ? &doc.keys : nullptr, options.packNumbers);
+  auto consumed = parseWith(builder, buff, options.maxDepth);
+  doc.root = consumed ? builder.root() : nullptr;
+  return {doc.root, consumed};
+}
+
+size_t Json::parse(Handler &handler, std::string_view buff, const ParseOptions &options) {
+  return parseWith(handler, buff, options.maxDepth);
+}
+
+Json::Writer::Writer(FILE *file)
+    : sink([file](const char *data, size_t size) { std::fwrite(data, 1, size, file); }) {}
+
+void Json::Writer::flush() {
+  if (sink && len) {
+    sink(buff.get(), len);
+    len = 0;
+  }
+}
+
+void Json::Writer::reserve(size_t size) {
+  flush();
+  if (size <= cap - len) {
+    return;
+  }
+  auto grown = std::max({blockSize, 2 * cap, len + size});
+  auto next = std::make_unique<char[]>(grown);
+  if (len) {
+    std::memcpy(next.get(), buff.get(), len);
+  }
+  buff = std::move(next);
+  cap = grown;
+}
+
+// Formats `value` into `buff` two digits at a time and returns the end.
+inline char *formatInteger(char *buff, long value) {
+  static const char pairs[] = "00010203040506070809101112131415161718192021222324"
+                              "25262728293031323334353637383940414243444546474849"
+                              "50515253545556575859606162636465666768697071727374"
+                              "75767778798081828384858687888990919293949596979899";
+  unsigned long v = value;
+  if (value < 0) {
+    *buff++ = '-';
+    v = 0 - v;
+  }
+  char digits[20];
+  char *p = digits + sizeof(digits);
+  while (v >= 100) {
+    auto pair = pairs + (v % 100) * 2;
+    v /= 100;
+    *--p = pair[1];
+    *--p = pair[0];
+  }
+  if (v >= 10) {
+    *--p = pairs[v * 2 + 1];
+    *--p = pairs[v * 2];
+  } else {
+    *--p = static_cast<char>('0' + v);
+  }
+  auto len = digits + sizeof(digits) - p;
+  std::memcpy(buff, p, len);
+  return buff + len;
+}
+
+// Formats `value` as the shortest text that parses back to the same bits,
+// via std::to_chars (Ryu in libstdc++). Integral values keep a ".0" so they
+// read back as floating, and non-finite values, which JSON cannot express,
+// become null.
+inline char *formatFloating(char *buff, double value) {
+  if (!std::isfinite(value)) {
+    std::memcpy(buff, "null", 4);
+    return buff + 4;
+  }
+  auto end = std::to_chars(buff, buff + 32, value).ptr;
+  if (std::find_if(buff, end, [](char ch) { return ch == '.' || ch == 'e'; }) == end) {
+    *end++ = '.';
+    *end++ = '0';
+  }
+  return end;
+}
+
+namespace {
+
+struct Serializer {
+  Json::Writer &out;
+  const Json::PrintOptions &options;
+
+  void indent(int n) { out.fill(' ', n); }
+
+  // Writes `str` quoted, copying clean spans as blocks and escaping quotes,
+  // backslashes and control characters.
+  void string(std::string_view str) {
+    static const char hex[] = "0123456789abcdef";
+    out.put('"');
+    auto span = str.begin();
+    for (auto it = str.begin(); it != str.end(); ++it) {
+      auto ch = static_cast<unsigned char>(*it);
+      if (ch >= 0x20 && ch != '"' && ch != '\\') {
+        continue;
+      }
+      out.write(str.data() + (span - str.begin()), it - span);
+      span = it + 1;
+      switch (ch) {
+      case '"': out.write("\\\"", 2); break;
+      case '\\': out.write("\\\\", 2); break;
+      case '\b': out.write("\\b", 2); break;
+      case '\f': out.write("\\f", 2); break;
+      case '\n': out.write("\\n", 2); break;
+      case '\r': out.write("\\r", 2); break;
+      case '\t': out.write("\\t", 2); break;
+      default: {
+        char esc[] = {'\\', 'u', '0', '0', hex[ch >> 4], hex[ch & 0xf]};
+        out.write(esc, sizeof(esc));
+      }
       }
-    } else {
-      throw "type error: object";
     }
-  } else if (value->type == "array") {
-    if (auto p = std::dynamic_pointer_cast<JsonArray>(value)) {
-      if (p->values.size() == 0) {
-        printf("%.*s[]", narrow ? 0 : indent, spaces);
+    out.write(str.data() + (span - str.begin()), str.end() - span);
+    out.put('"');
+  }
+
+  void member(const Json::JsonObject::Pair &pair, int indent, bool last) {
+    this->indent(indent);
+    string(pair.first);
+    out.write(": ", 2);
+    value(pair.second, indent, true);
+    if (!last) {
+      out.put(',');
+    }
+    out.put('\n');
+  }
+
+  void value(Json::JsonValue value, int indent, bool narrow);
+  void object(const Json::JsonObject &obj, int indent);
+  void array(const Json::JsonArray &arr, int indent);
+};
+
+void Serializer::value(Json::JsonValue value, int indent, bool narrow) {
+  if (!value) {
+    out.write("undefined");
+    return;
+  }
+  if (!narrow) {
+    this->indent(indent);
+  }
+  Json::visit(value, Json::overloaded{
+    [&](std::nullptr_t) { out.write("null", 4); },
+    [&](bool value) {
+      if (value) {
+        out.write("true", 4);
       } else {
-        printf("%.*s[\n", narrow ? 0 : indent, spaces);
-        for (auto &v : p->values) {
-          print(v, indent + 2);
-          if (v != p->values.back()) {
-            printf(",");
-          }
-          printf("\n");
-        }
-        printf("%.*s]", indent, spaces);
+        out.write("false", 5);
       }
-    } else {
-      throw "type error: array";
+    },
+    [&](long value) {
+      char buff[40];
+      out.write(buff, formatInteger(buff, value) - buff);
+    },
+    [&](double value) {
+      char buff[40];
+      out.write(buff, formatFloating(buff, value) - buff);
+    },
+    [&](std::string_view value) { string(value); },
+    [&](const Json::JsonObject &obj) { object(obj, indent); },
+    [&](const Json::JsonArray &arr) { array(arr, indent); },
+  });
+}
+
+void Serializer::object(const Json::JsonObject &obj, int indent) {
+  const auto size = obj.size();
+  if (size == 0) {
+    out.write("{}", 2);
+    return;
+  }
+  out.write("{\n", 2);
+  if (options.sortKeys) {
+    std::vector<const Json::JsonObject::Pair *> sorted(size);
+    std::transform(obj.begin(), obj.end(), sorted.begin(), [](auto &pair) { return &pair; });
+    std::sort(sorted.begin(), sorted.end(), [](auto a, auto b) { return a->first < b->first; });
+    for (size_t i = 0; i < size; i++) {
+      member(*sorted[i], indent + 2, i + 1 == size);
+    }
+  } else {
+    for (size_t i = 0; i < size; i++) {
+      member(obj[i], indent + 2, i + 1 == size);
+    }
+  }
+  this->indent(indent);
+  out.put('}');
+}
+
+void Serializer::array(const Json::JsonArray &arr, int indent) {
+  const auto size = arr.size();
+  if (size == 0) {
+    out.write("[]", 2);
+    return;
+  }
+  out.write("[\n", 2);
+  for (size_t i = 0; i < size; i++) {
+    value(arr[i], indent + 2, false);
+    if (i + 1 != size) {
+      out.put(',');
     }
+    out.put('\n');
   }
+  this->indent(indent);
+  out.put(']');
+}
+
+} // namespace
+
+void Json::write(Writer &out, JsonValue value, int indent, bool narrow, const PrintOptions &options) {
+  Serializer{out, options}.value(value, indent, narrow);
+}
+
+std::string Json::dump(JsonValue value, int indent, const PrintOptions &options) {
+  Writer out;
+  write(out, value, indent, false, options);
+  return std::string(out.str());
+}
+
+void Json::print(JsonValue value, int indent, bool narrow, const PrintOptions &options) {
+  Writer out(stdout);
+  write(out, value, indent, narrow, options);
 }
-#endif
@@ -1,56 +1,701 @@
 #ifndef __JSON_HPP__
 #define __JSON_HPP__
 
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
 #include <memory>
+#include <memory_resource>
+#include <optional>
 #include <string>
 #include <string_view>
-#include <unordered_map>
+#include <type_traits>
 #include <vector>
 
 struct Json {
 
-  struct JsonBase {
-    JsonBase(const std::string &type) : type(type) {}
-    virtual ~JsonBase() {}
-    std::string type;
-  };
+  // Bump allocator backing every node of one Document. Memory comes from a
+  // few geometrically growing chunks and is only ever released all at once,
+  // so deallocation is a no-op and node destructors are never run.
+  class Arena : public std::pmr::memory_resource {
+  public:
+    Arena() = default;
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+    ~Arena();
+
+    template <typename T, typename... Args> T *make(Args &&...args) {
+      return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    // Copy of `text` in the arena.
+    std::string_view store(std::string_view text);
+
+    size_t chunks() const { return count; }
+    size_t bytes() const { return reserved; }
 
-  struct JsonString : JsonBase {
-    JsonString(const std::string &val) : JsonBase("string"), value(val) {}
-    std::string value;
+  private:
+    struct Chunk {
+      Chunk *next;
+    };
+
+    void *do_allocate(size_t bytes, size_t align) override;
+    void do_deallocate(void *, size_t, size_t) override {}
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override { return this == &other; }
+
+    Chunk *head = nullptr;
+    char *cur = nullptr;
+    char *limit = nullptr;
+    size_t count = 0;
+    size_t reserved = 0;
   };
 
-  struct JsonNumber : JsonBase {
-    JsonNumber(double val) : JsonBase("number"), numType("floating"), value{ .floating = val } {}
-    JsonNumber(long val) : JsonBase("number"), numType("integer"), value{ .integer = val } {}
-    std::string numType;
+  enum class Kind : uint8_t { Null, Boolean, Number, String, Array, Object };
+
+  enum class NumberKind : uint8_t { Integer, Floating };
+
+  struct JsonArray;
+  struct JsonObject;
+
+  // One JSON value in 16 bytes: a tag and an inline payload. Numbers and
+  // booleans are stored in place, strings refer to their bytes (in the arena
+  // or the input) and containers to their node in the arena, so only arrays
+  // and objects are allocated. A default-constructed value, or nullptr,
+  // holds no value at all; parse returns one when the input has none.
+  class JsonValue {
+  public:
+    JsonValue() : tag_(Tag::None), size_(0), integer_(0) {}
+    JsonValue(std::nullptr_t) : JsonValue() {}
+    explicit JsonValue(bool value) : tag_(value ? Tag::True : Tag::False), size_(0), integer_(0) {}
+    explicit JsonValue(long value) : tag_(Tag::Integer), size_(0), integer_(value) {}
+    // Other integer types, so JsonValue(5) is not ambiguous.
+    template <typename T, typename = std::enable_if_t<std::is_integral_v<T> && !std::is_same_v<T, bool>>>
+    explicit JsonValue(T value) : JsonValue(toLong(value)) {}
+    explicit JsonValue(double value) : tag_(Tag::Floating), size_(0), floating_(value) {}
+    // Refers to `value`, which must outlive it; copy it with Arena::store
+    // otherwise.
+    explicit JsonValue(std::string_view value);
+    // A string, not the boolean a pointer would otherwise convert to.
+    explicit JsonValue(const char *value) : JsonValue(std::string_view(value)) {}
+    JsonValue(JsonArray *array) : tag_(Tag::Array), size_(0), node_(array) {}
+    JsonValue(JsonObject *object) : tag_(Tag::Object), size_(0), node_(object) {}
+    static JsonValue null() {
+      JsonValue value;
+      value.tag_ = Tag::Null;
+      return value;
+    }
+
+    // False when there is no value.
+    explicit operator bool() const { return tag_ != Tag::None; }
+
+    // Null for no value as well.
+    Kind kind() const {
+      switch (tag_) {
+      case Tag::False: case Tag::True: return Kind::Boolean;
+      case Tag::Integer: case Tag::Floating: return Kind::Number;
+      case Tag::String: return Kind::String;
+      case Tag::Array: return Kind::Array;
+      case Tag::Object: return Kind::Object;
+      default: return Kind::Null;
+      }
+    }
+    bool isNull() const { return tag_ == Tag::Null; }
+    bool isBoolean() const { return tag_ == Tag::False || tag_ == Tag::True; }
+    bool isNumber() const { return tag_ == Tag::Integer || tag_ == Tag::Floating; }
+    bool isString() const { return tag_ == Tag::String; }
+    bool isArray() const { return tag_ == Tag::Array; }
+    bool isObject() const { return tag_ == Tag::Object; }
+    bool isInteger() const { return tag_ == Tag::Integer; }
+    bool isFloating() const { return tag_ == Tag::Floating; }
+
+    // Scalar accessors throw a "type error" on a mismatch.
+    NumberKind numKind() const;
+    bool asBool() const;
+    long asInteger() const;
+    double asFloating() const; // integers convert
+    std::string_view asString() const;
+
+    // Container node, e.g. `value.as<JsonObject>()`; nullptr on mismatch.
+    template <typename T> T *as() const {
+      return tag_ == (T::Tag == Kind::Array ? Tag::Array : Tag::Object) ? static_cast<T *>(node_) : nullptr;
+    }
+
+  private:
+    friend struct Json; // visit
+
+    template <typename T> static long toLong(T value) {
+      if (std::is_unsigned_v<T> && sizeof(T) >= sizeof(long) && value > static_cast<T>(LONG_MAX)) {
+        throw "integer too large";
+      }
+      return static_cast<long>(value);
+    }
+    enum class Tag : uint8_t { None, Null, False, True, Integer, Floating, String, Array, Object };
+
+    Tag tag_;
+    uint32_t size_; // string length
     union {
-      double floating;
-      long integer;
-    } value;
+      long integer_;
+      double floating_;
+      const char *chars_;
+      void *node_;
+    };
+  };
+  static_assert(sizeof(JsonValue) == 16, "JsonValue is a tag and an 8-byte payload");
+
+  struct JsonObject {
+    static constexpr Kind Tag = Kind::Object;
+    using Pair = std::pair<std::string_view, JsonValue>;
+
+    JsonObject(Arena &arena) : pairs(&arena) {}
+
+    // Pair count and pairs in insertion order. Read-only, so the hash index
+    // never outlives the pairs it was built over; add pairs through set().
+    size_t size() const { return pairs.size(); }
+    const Pair &operator[](size_t i) const { return pairs[i]; }
+    const Pair *begin() const { return pairs.data(); }
+    const Pair *end() const { return pairs.data() + pairs.size(); }
+    void reserve(size_t count) { pairs.reserve(count); }
+
+    // Value stored under `key`, or no value.
+    JsonValue find(std::string_view key) const;
+
+    // Appends a pair, or replaces the value if `key` is already present so
+    // the last of duplicate keys wins. The key is kept as a view; copy it
+    // with Arena::store unless it outlives the object.
+    void set(std::string_view key, JsonValue value);
+
+  private:
+    static constexpr size_t indexThreshold = 16;
+
+    // Small objects are searched linearly; past indexThreshold pairs a hash
+    // index over them is built on first use.
+    std::pmr::vector<Pair> pairs;
+
+    long lookup(std::string_view key) const;
+    void rebuildIndex() const;
+
+    // Open-addressed table of pair positions plus one, 0 marking a free slot.
+    mutable uint32_t *index = nullptr;
+    mutable uint32_t indexMask = 0;
+    mutable uint32_t indexed = 0;
+  };
+
+  // How a JsonArray stores its elements.
+  enum class Packing : uint8_t { None, Integers, Floats };
+
+  struct JsonArray {
+    static constexpr Kind Tag = Kind::Array;
+    JsonArray(Arena &arena) : values(&arena) {}
+
+    // Element count and elements, whatever the packing.
+    size_t size() const { return packing_ == Packing::None ? values.size() : count_; }
+    JsonValue operator[](size_t i) const {
+      switch (packing_) {
+      case Packing::Integers: return JsonValue(static_cast<const long *>(packed_)[i]);
+      case Packing::Floats: return JsonValue(static_cast<const double *>(packed_)[i]);
+      default: return values[i];
+      }
+    }
+
+    // Walks the elements by value, whatever the packing.
+    class Iterator {
+    public:
+      JsonValue operator*() const { return (*array)[index]; }
+      Iterator &operator++() {
+        index++;
+        return *this;
+      }
+      bool operator==(const Iterator &other) const { return index == other.index; }
+      bool operator!=(const Iterator &other) const { return index != other.index; }
+
+    private:
+      friend struct JsonArray;
+      Iterator(const JsonArray *array, size_t index) : array(array), index(index) {}
+
+      const JsonArray *array;
+      size_t index;
+    };
+    Iterator begin() const { return Iterator(this, 0); }
+    Iterator end() const { return Iterator(this, size()); }
+
+    // Replaces the elements with [first, last). With `packNumbers`, numbers
+    // that are all integers or all floating are packed into the arena.
+    void assign(const JsonValue *first, const JsonValue *last, bool packNumbers = false);
+    // Appends or replaces an element; a packed array is unpacked first.
+    void push_back(JsonValue value);
+    void set(size_t i, JsonValue value);
+
+    // Arrays of only integers, or only floating numbers, may be packed into
+    // one contiguous block of longs or doubles.
+    Packing packing() const { return packing_; }
+    // The packed elements, or nullptr if the array is not packed that way.
+    const long *integers() const { return packing_ == Packing::Integers ? static_cast<const long *>(packed_) : nullptr; }
+    const double *floats() const { return packing_ == Packing::Floats ? static_cast<const double *>(packed_) : nullptr; }
+
+    // Makes this a packed array of the `count` numbers at `data`, which must
+    // outlive it (allocate them from the arena).
+    void pack(const long *data, size_t count) { setPacked(Packing::Integers, data, count); }
+    void pack(const double *data, size_t count) { setPacked(Packing::Floats, data, count); }
+
+  private:
+    void setPacked(Packing packing, const void *data, size_t count) {
+      if (count > UINT32_MAX) {
+        throw "array too large to pack";
+      }
+      values.clear();
+      packing_ = packing;
+      packed_ = data;
+      count_ = static_cast<uint32_t>(count);
+    }
+    void unpack();
+
+    // Elements of an unpacked array; empty when packed.
+    std::pmr::vector<JsonValue> values;
+    const void *packed_ = nullptr;
+    uint32_t count_ = 0;
+    Packing packing_ = Packing::None;
   };
 
-  struct JsonBoolean : JsonBase {
-    JsonBoolean(bool val) : JsonBase("boolean"), value(val) {}
-    bool value;
+  // Overload set built from lambdas, for visit:
+  //   Json::visit(value, Json::overloaded{[](long n) {...}, [](auto &&) {...}});
+  template <typename... Fs> struct overloaded : Fs... {
+    using Fs::operator()...;
   };
+  template <typename... Fs> overloaded(Fs...) -> overloaded<Fs...>;
 
-  using JsonValue = std::shared_ptr<JsonBase>;
+  // Calls `visitor` with the payload of `value`: std::nullptr_t for null (and
+  // for no value), bool, long, double, std::string_view, const JsonArray & or
+  // const JsonObject &. One switch on the tag, so a tree walk needs no
+  // kind()/as<>() pairs. Every overload must return the same type.
+  template <typename Visitor> static decltype(auto) visit(JsonValue value, Visitor &&visitor) {
+    using Tag = JsonValue::Tag;
+    switch (value.tag_) {
+    case Tag::False: return visitor(false);
+    case Tag::True: return visitor(true);
+    case Tag::Integer: return visitor(value.integer_);
+    case Tag::Floating: return visitor(value.floating_);
+    case Tag::String: return visitor(std::string_view(value.chars_, value.size_));
+    case Tag::Array: return visitor(static_cast<const JsonArray &>(*static_cast<JsonArray *>(value.node_)));
+    case Tag::Object: return visitor(static_cast<const JsonObject &>(*static_cast<JsonObject *>(value.node_)));
+    default: return visitor(nullptr);
+    }
+  }
 
-  struct JsonObject : JsonBase {
-    JsonObject(bool isNull = false) : JsonBase("object"), isNull(isNull) {}
-    std::unordered_map<std::string, JsonValue> pairs;
-    bool isNull;
+  // The distinct object keys of one document. Each is stored once and every
+  // object refers to that copy, so keys read by the same parse are equal
+  // exactly when their data pointers are.
+  class KeyTable {
+  public:
+    explicit KeyTable(Arena &arena) : arena(&arena) {}
+
+    // The stored instance of `key`, added on first sight: copied into the
+    // arena, or kept as given when `borrowed`.
+    std::string_view intern(std::string_view key, bool borrowed = false);
+    // The stored instance of `key`, or nothing if no object has that key.
+    std::optional<std::string_view> find(std::string_view key) const;
+    size_t size() const { return count; }
+
+  private:
+    size_t probe(std::string_view key) const;
+    void grow();
+
+    Arena *arena;
+    // Open-addressed by hash; an empty view marks a free slot.
+    std::vector<std::string_view> slots;
+    size_t count = 0;
+    // The empty key needs no slot; this records whether it was seen.
+    bool hasEmpty = false;
   };
 
-  struct JsonArray : JsonBase {
-    JsonArray() : JsonBase("array") {}
-    std::vector<JsonValue> values;
+  // Owns the arena that all nodes of one parse live in; dropping the document
+  // frees the whole tree at once. Movable, since nodes only point into the
+  // heap-allocated arena and never at the document itself.
+  struct Document {
+    Document() : arena(std::make_unique<Arena>()), keys(*arena) {}
+    std::unique_ptr<Arena> arena;
+    // Arenas filled by parser threads. Values built there keep using the
+    // arena they came from, so it lives as long as the document.
+    std::vector<std::unique_ptr<Arena>> arenas;
+    // Keys of the objects parsed into `arena`. Looking a field up with the
+    // view from keys.find() matches by pointer before comparing bytes.
+    // With more than one thread, parseLines and the parallel array path
+    // intern keys into per-thread tables that are not kept, so their keys
+    // are missing here; one-thread parses intern into this table.
+    KeyTable keys;
+    JsonValue root = nullptr;
   };
 
-  static std::pair<JsonValue, size_t> parse(const std::string_view &buff);
+  // Read-only "tape" form of a document: one contiguous array of 64-bit
+  // words, each a kind tag in the top byte and a payload below it, with the
+  // string bytes in a separate buffer. Scalars take one word, or two for
+  // numbers; containers take an opening and a closing word that point at
+  // each other, so skipping a subtree is O(1). Built by the two-stage engine.
+  class Tape {
+  public:
+    class Iterator;
+
+    // Cursor on one value of a tape; cheap to copy. Accessors of the wrong
+    // kind throw a "type error"; a default-constructed or not-found Value is
+    // false in a boolean context, and every accessor on it throws "type
+    // error: no value".
+    class Value {
+    public:
+      Value() = default;
+      explicit operator bool() const { return tape != nullptr; }
+
+      Kind kind() const;
+      bool isNull() const { return kind() == Kind::Null; }
+      bool isBoolean() const { return kind() == Kind::Boolean; }
+      bool isNumber() const { return kind() == Kind::Number; }
+      bool isString() const { return kind() == Kind::String; }
+      bool isArray() const { return kind() == Kind::Array; }
+      bool isObject() const { return kind() == Kind::Object; }
+      NumberKind numKind() const;
+
+      bool asBool() const;
+      long asInteger() const;
+      double asFloating() const; // integers convert
+      std::string_view asString() const;
+
+      // Elements of an array or pairs of an object.
+      size_t size() const;
+      // Array element `i` (linear in i), or an invalid Value.
+      Value operator[](size_t i) const;
+      // Value of the first pair named `key`, or an invalid Value.
+      Value find(std::string_view key) const;
+
+      // Elements of an array, or pairs of an object (see Iterator::key()).
+      Iterator begin() const;
+      Iterator end() const;
+
+    private:
+      friend class Tape;
+      friend class Iterator;
+      Value(const Tape *tape, size_t index) : tape(tape), index(index) {}
+      void expect(char tag, const char *error) const;
+
+      const Tape *tape = nullptr;
+      size_t index = 0;
+    };
+
+    class Iterator {
+    public:
+      // The element, or the value of the current pair.
+      Value operator*() const { return Value(tape, object ? tape->next(index) : index); }
+      // Key of the current pair; objects only.
+      std::string_view key() const { return tape->string(index); }
+      Iterator &operator++();
+      bool operator==(const Iterator &other) const { return index == other.index; }
+      bool operator!=(const Iterator &other) const { return index != other.index; }
+
+    private:
+      friend class Value;
+      Iterator(const Tape *tape, size_t index, bool object) : tape(tape), index(index), object(object) {}
+
+      const Tape *tape;
+      size_t index;
+      bool object;
+    };
+
+    // Throws on malformed input like parse(). Input without a root value
+    // gives an empty tape whose root() is invalid.
+    static Tape parse(std::string_view buff);
+
+    Value root() const { return tape.empty() ? Value() : Value(this, 0); }
+
+    // Footprint: number of 64-bit words and string bytes.
+    size_t words() const { return tape.size(); }
+    size_t stringBytes() const { return strings.size(); }
+
+  private:
+    class Builder;
+
+    char tag(size_t index) const { return static_cast<char>(tape[index] >> 56); }
+    uint64_t payload(size_t index) const { return tape[index] & ((uint64_t(1) << 56) - 1); }
+    // Index of the value following the one at `index`.
+    size_t next(size_t index) const;
+    std::string_view string(size_t index) const;
+
+    std::vector<uint64_t> tape;
+    std::string strings;
+  };
+
+  // On-demand view of JSON text that has not been parsed. Nothing is
+  // validated or decoded until it is asked for; finding a field or element
+  // skips the values in front of it with a bracket-matching scan instead of
+  // parsing them. Cheap to copy; the text must outlive every view into it.
+  // Malformed input surfaces as a "syntax error" only when reached.
+  class Lazy {
+  public:
+    class Iterator;
+
+    Lazy() = default;
+    // View of the value at the start of `buff`; invalid if there is none.
+    explicit Lazy(std::string_view buff);
+    explicit operator bool() const { return p != nullptr; }
+
+    // Judged from the first byte only.
+    Kind kind() const;
+    bool isNull() const { return kind() == Kind::Null; }
+    bool isBoolean() const { return kind() == Kind::Boolean; }
+    bool isNumber() const { return kind() == Kind::Number; }
+    bool isString() const { return kind() == Kind::String; }
+    bool isArray() const { return kind() == Kind::Array; }
+    bool isObject() const { return kind() == Kind::Object; }
+
+    bool asBool() const;
+    long asInteger() const;
+    double asFloating() const; // integers convert
+    // View into the text when the string has no escapes, otherwise into
+    // `scratch`, which receives the decoded string.
+    std::string_view asString(std::string &scratch) const;
+    std::string asString() const;
+
+    // Value of the first pair named `key`, or an invalid view. Unlike the
+    // DOM, where the last duplicate wins, the search stops at the first.
+    Lazy find(std::string_view key) const;
+    Lazy operator[](std::string_view key) const { return find(key); }
+    // Array element `i`, or an invalid view.
+    Lazy at(size_t i) const;
+    // Elements of an array or pairs of an object; skips over all of them.
+    size_t size() const;
+
+    // Elements of an array, or pairs of an object (see Iterator::key()).
+    Iterator begin() const;
+    Iterator end() const;
+
+    // The text of this value, found by skipping over it.
+    std::string_view raw() const;
+    // Fully parses this value into `doc`, which then has it as its root.
+    JsonValue materialize(Document &doc) const;
+
+  private:
+    friend class Iterator;
+    Lazy(const char *p, const char *limit) : p(p), limit(limit) {}
+    void expect(Kind kind, const char *error) const;
+
+    const char *p = nullptr;
+    const char *limit = nullptr;
+  };
+
+  // Forward iterator over a Lazy array or object. Advancing skips the
+  // current value unparsed.
+  class Lazy::Iterator {
+  public:
+    Lazy operator*() const { return Lazy(value, limit); }
+    // Key of the current pair; objects only. Decoded into the iterator when
+    // it has escapes.
+    std::string_view key() const { return decoded ? std::string_view(scratch) : name; }
+    Iterator &operator++();
+    bool operator==(const Iterator &other) const { return value == other.value; }
+    bool operator!=(const Iterator &other) const { return value != other.value; }
+
+  private:
+    friend class Lazy;
+    Iterator(const char *p, const char *limit, bool object);
+    // Positions on the element starting at p, or at the end on the
+    // container's closing bracket.
+    void enter(const char *p);
+
+    const char *value = nullptr; // current element, nullptr at the end
+    const char *limit = nullptr;
+    bool object = false;
+    std::string_view name; // raw key, unless decoded into scratch
+    bool decoded = false;
+    std::string scratch;
+  };
+
+  enum class Engine : uint8_t {
+    // One pass straight over the text.
+    SinglePass,
+    // SIMD structural index first, then a walk over the index. Slower than
+    // SinglePass: the walk still reads scalars and spaces from the text.
+    TwoStage,
+  };
+
+  struct ParseOptions {
+    ParseOptions()
+        : engine(Engine::SinglePass), threads(1), borrowStrings(false), internKeys(true), packNumbers(true),
+          maxDepth(1024) {}
+    Engine engine;
+    // Parser threads for parseLines and for the elements of a large
+    // top-level array; 0 means one per hardware thread.
+    unsigned threads;
+    // Strings and keys without escapes refer to the input instead of being
+    // copied into the arena; the input must then outlive the document.
+    bool borrowStrings;
+    // Object keys go through Document::keys, so each distinct key is stored
+    // once. Costs a hash probe per key.
+    bool internKeys;
+    // Arrays of only integers or only floating numbers are packed; see
+    // JsonArray::packing().
+    bool packNumbers;
+    // Most arrays and objects open at once; deeper input fails with "syntax
+    // error: nesting too deep". The parsers keep open containers on a heap
+    // stack, but dump/print recurse once per level.
+    size_t maxDepth;
+  };
+
+  static std::pair<JsonValue, size_t> parse(Document &doc, const std::string_view &buff,
+                                            const ParseOptions &options = ParseOptions());
+
+  // Newline-delimited JSON: one value per line, blank lines skipped. Returns
+  // the values in input order and leaves doc.root null; a line that does not
+  // hold exactly one value is a syntax error. With several threads the input
+  // is cut into equal spans at line boundaries, each parsed into its own
+  // arena.
+  static std::vector<JsonValue> parseLines(Document &doc, std::string_view buff,
+                                           const ParseOptions &options = ParseOptions());
+
+  // Receives the values of a document in text order, without a DOM. Strings
+  // and keys are views that stay valid only for the call: into the input
+  // when the text has no escapes, otherwise into a decoding buffer. The
+  // count passed when a container ends is its number of elements or pairs.
+  // Every callback does nothing unless overridden.
+  class Handler {
+  public:
+    virtual ~Handler() = default;
+    virtual void onNull() {}
+    virtual void onBool(bool /*value*/) {}
+    virtual void onNumber(long /*value*/) {}
+    virtual void onNumber(double /*value*/) {}
+    virtual void onString(std::string_view /*value*/) {}
+    virtual void onKey(std::string_view /*key*/) {}
+    virtual void onStartObject() {}
+    virtual void onEndObject(size_t /*count*/) {}
+    virtual void onStartArray() {}
+    virtual void onEndArray(size_t /*count*/) {}
+  };
+
+  // Parses the same grammar as the single-pass engine, reporting to
+  // `handler`. Returns the offset just past the root value, or 0 when the
+  // input does not start with one. Only options.maxDepth applies.
+  static size_t parse(Handler &handler, std::string_view buff, const ParseOptions &options = ParseOptions());
+
+  // Incremental form of parse(Handler&, ...) for input that arrives in
+  // pieces. Chunks may split the text anywhere; a token cut off at the end of
+  // a chunk is carried over, and events for it are sent once the rest
+  // arrives; each chunk is scanned once for where that token ends. The
+  // container stack lives in the parser, so nothing else is buffered. Text
+  // after the root value is ignored.
+  class StreamParser {
+  public:
+    // Only options.maxDepth applies.
+    explicit StreamParser(Handler &handler, const ParseOptions &options = ParseOptions())
+        : handler(handler), maxDepth(options.maxDepth) {}
+
+    void feed(std::string_view chunk);
+    // Ends the input, completing a number or literal left at the end.
+    // Returns whether a root value was parsed, false when the input does not
+    // start with one (as parse(Handler&, ...) returns 0); throws if the input
+    // stopped inside one.
+    bool finish();
+    // Whether the root value has been completed.
+    bool done() const { return state == State::Done; }
+
+  private:
+    // NoValue: the input does not start with a value; the rest is ignored.
+    enum class State : uint8_t { Value, Element, Key, Colon, Next, Done, NoValue };
+    struct Frame {
+      bool object;
+      size_t count;
+    };
+
+    size_t run(std::string_view data, bool final);
+    bool value(const char *&p, const char *end, bool final);
+    bool key(const char *&p, const char *end, bool final);
+    bool noValue();
+    void open(bool object);
+    void carry();
+    size_t tokenEnd(std::string_view data);
+    void completed();
+
+    Handler &handler;
+    size_t maxDepth;
+    State state = State::Value;
+    std::vector<Frame> frames;
+    // Start of a token the last chunk cut off, and where its scan stopped:
+    // its quote if it is a string (0 otherwise), and whether its last byte
+    // is an unfinished escape.
+    std::string pending;
+    char quote = 0;
+    bool escaped = false;
+    std::string scratch;
+  };
+
+  // Output buffer for the serializer. Bytes collect in memory and reach the
+  // sink in large blocks; a writer without a sink just keeps growing and its
+  // contents are read back with str().
+  class Writer {
+  public:
+    using Sink = std::function<void(const char *, size_t)>;
+
+    Writer() = default;
+    explicit Writer(FILE *file);
+    explicit Writer(Sink sink) : sink(std::move(sink)) {}
+    Writer(const Writer &) = delete;
+    Writer &operator=(const Writer &) = delete;
+    ~Writer() { flush(); }
+
+    // Empty writes return early: `data` may then be null, as may the buffer
+    // of a fresh writer.
+    void write(const char *data, size_t size) {
+      if (size == 0) {
+        return;
+      }
+      if (size > cap - len) {
+        reserve(size);
+      }
+      std::memcpy(buff.get() + len, data, size);
+      len += size;
+    }
+    void write(std::string_view str) { write(str.data(), str.size()); }
+    void put(char ch) {
+      if (len == cap) {
+        reserve(1);
+      }
+      buff[len++] = ch;
+    }
+    void fill(char ch, size_t count) {
+      if (count == 0) {
+        return;
+      }
+      if (count > cap - len) {
+        reserve(count);
+      }
+      std::memset(buff.get() + len, ch, count);
+      len += count;
+    }
+
+    void flush();
+    std::string_view str() const { return std::string_view(buff.get(), len); }
+
+  private:
+    static constexpr size_t blockSize = 64 << 10;
+
+    // Makes room for `size` more bytes, flushing first when there is a sink.
+    void reserve(size_t size);
+
+    std::unique_ptr<char[]> buff;
+    size_t len = 0;
+    size_t cap = 0;
+    Sink sink;
+  };
+
+  struct PrintOptions {
+    PrintOptions() : sortKeys(false) {}
+    // Emit object pairs sorted by key instead of in insertion order.
+    bool sortKeys;
+  };
+
+  static void write(Writer &out, JsonValue value, int indent = 0, bool narrow = false,
+                    const PrintOptions &options = PrintOptions());
+
+  static std::string dump(JsonValue value, int indent = 0, const PrintOptions &options = PrintOptions());
 
-  static void print(JsonValue value, int indent = 0, bool narrow = false);
+  static void print(JsonValue value, int indent = 0, bool narrow = false, const PrintOptions &options = PrintOptions());
 };
 
 #endif //__JSON_HPP__
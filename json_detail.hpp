@@ -0,0 +1,416 @@
+#ifndef __JSON_DETAIL_HPP__
+#define __JSON_DETAIL_HPP__
+
+// Token readers and the DOM builder shared by the parse engines. Internal to
+// the library; not installed alongside json.hpp.
+
+#include "json.hpp"
+#include "json_simd.hpp"
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <vector>
+
+inline void skipSpaces(const char *&p, const char *end) {
+  p = simd::skipSpaces(p, end);
+}
+
+inline unsigned readHex4(const char *&p, const char *end) {
+  if (end - p < 4) {
+    throw "syntax error: invalid unicode escape";
+  }
+  unsigned code = 0;
+  for (int i = 0; i < 4; i++, p++) {
+    char ch = *p;
+    code <<= 4;
+    if (ch >= '0' && ch <= '9') {
+      code |= ch - '0';
+    } else if ((ch | 0x20) >= 'a' && (ch | 0x20) <= 'f') {
+      code |= (ch | 0x20) - 'a' + 10;
+    } else {
+      throw "syntax error: invalid unicode escape";
+    }
+  }
+  return code;
+}
+
+inline void appendUtf8(std::string &buff, unsigned code) {
+  if (code < 0x80) {
+    buff += static_cast<char>(code);
+  } else if (code < 0x800) {
+    buff += static_cast<char>(0xc0 | (code >> 6));
+    buff += static_cast<char>(0x80 | (code & 0x3f));
+  } else if (code < 0x10000) {
+    buff += static_cast<char>(0xe0 | (code >> 12));
+    buff += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+    buff += static_cast<char>(0x80 | (code & 0x3f));
+  } else {
+    buff += static_cast<char>(0xf0 | (code >> 18));
+    buff += static_cast<char>(0x80 | ((code >> 12) & 0x3f));
+    buff += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+    buff += static_cast<char>(0x80 | (code & 0x3f));
+  }
+}
+
+// Reads a string body from just past its opening `quote` and leaves p past
+// the closing one. Returns a view into the input when the body has no
+// escapes, otherwise decodes it into `scratch` and returns a view of that.
+inline std::string_view readString(const char *&p, const char *end, char quote, std::string &scratch) {
+  auto start = p;
+  p = simd::findQuoteOrEscape(p, end, quote);
+  if (p != end && *p == quote) {
+    return std::string_view(start, (p++) - start);
+  }
+  scratch.assign(start, p);
+  while (p != end && *p != quote) {
+    if (end - p < 2) {
+      throw "syntax error: unterminated string";
+    }
+    char esc = p[1];
+    p += 2;
+    switch (esc) {
+    case '"': case '\'': case '\\': case '/': scratch += esc; break;
+    case 'b': scratch += '\b'; break;
+    case 'f': scratch += '\f'; break;
+    case 'n': scratch += '\n'; break;
+    case 'r': scratch += '\r'; break;
+    case 't': scratch += '\t'; break;
+    case 'u': {
+      auto code = readHex4(p, end);
+      if (code >= 0xd800 && code < 0xdc00) {
+        if (end - p < 2 || p[0] != '\\' || p[1] != 'u') {
+          throw "syntax error: unpaired surrogate";
+        }
+        p += 2;
+        auto low = readHex4(p, end);
+        if (low < 0xdc00 || low >= 0xe000) {
+          throw "syntax error: unpaired surrogate";
+        }
+        code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+      } else if (code >= 0xdc00 && code < 0xe000) {
+        throw "syntax error: unpaired surrogate";
+      }
+      appendUtf8(scratch, code);
+      break;
+    }
+    default:
+      throw "syntax error: invalid escape";
+    }
+    auto span = p;
+    p = simd::findQuoteOrEscape(p, end, quote);
+    scratch.append(span, p);
+  }
+  if (p == end) {
+    throw "syntax error: unterminated string";
+  }
+  p += 1;
+  return scratch;
+}
+
+inline bool isDigit(char ch) { return static_cast<unsigned char>(ch - '0') < 10; }
+
+// Parses a number in one pass, leaving p just past it. Digits without a
+// fraction or exponent that fit in a long become an integer; everything
+// else is a double. Up to 19 significant digits are accumulated exactly; a
+// mantissa of at most 2^53 with a power of ten up to 22 is finished with
+// Clinger's fast path (one exact multiply or divide). Anything else goes to
+// std::from_chars, which is correctly rounded and ignores the C locale; the
+// Eisel-Lemire algorithm is left to libstdc++'s implementation of it. Values
+// with 16 or more significant digits, such as most coordinates in
+// canada.json, take that fallback.
+inline Json::JsonValue readNumber(const char *&p, const char *end) {
+  static const double exact[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+                                 1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+                                 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+  const char *start = p;
+  bool negative = (p != end && *p == '-');
+  if (negative) {
+    p++;
+  }
+
+  uint64_t mantissa = 0;
+  int digits = 0;    // significant digits held in mantissa
+  int exponent = 0;  // decimal exponent applied to mantissa
+  bool truncated = false;
+  bool integral = true;
+  bool any = false;
+
+  auto accumulate = [&](int scale) {
+    for (; p != end && isDigit(*p); p++) {
+      any = true;
+      if (digits < 19) {
+        mantissa = mantissa * 10 + (*p - '0');
+        digits += (mantissa != 0);
+        exponent += scale;
+      } else {
+        truncated |= (*p != '0');
+        exponent += scale + 1;
+      }
+    }
+  };
+  accumulate(0);
+  if (p != end && *p == '.') {
+    p++;
+    integral = false;
+    accumulate(-1);
+  }
+  if (!any) {
+    throw "invalid number";
+  }
+  if (p != end && (*p | 0x20) == 'e') {
+    p++;
+    integral = false;
+    bool negExp = (p != end && *p == '-');
+    if (p != end && (*p == '-' || *p == '+')) {
+      p++;
+    }
+    if (p == end || !isDigit(*p)) {
+      throw "invalid number";
+    }
+    int exp = 0;
+    for (; p != end && isDigit(*p); p++) {
+      if (exp < 100000) {
+        exp = exp * 10 + (*p - '0');
+      }
+    }
+    exponent += negExp ? -exp : exp;
+  }
+
+  if (integral && !truncated && exponent == 0) {
+    if (mantissa <= static_cast<uint64_t>(std::numeric_limits<long>::max())) {
+      auto v = static_cast<long>(mantissa);
+      return Json::JsonValue(negative ? -v : v);
+    } else if (negative && mantissa == static_cast<uint64_t>(std::numeric_limits<long>::max()) + 1) {
+      return Json::JsonValue(std::numeric_limits<long>::min());
+    }
+  }
+
+  if (!truncated && mantissa <= (uint64_t(1) << 53) && exponent >= -22 && exponent <= 22) {
+    double v = static_cast<double>(mantissa);
+    v = exponent < 0 ? v / exact[-exponent] : v * exact[exponent];
+    return Json::JsonValue(negative ? -v : v);
+  }
+
+  double v = 0;
+  auto [ptr, ec] = std::from_chars(start, p, v);
+  if (ec == std::errc::result_out_of_range) {
+    v = exponent > 0 ? std::numeric_limits<double>::infinity() : 0.0;
+    v = negative ? -v : v;
+  } else if (ec != std::errc() || ptr != p) {
+    throw "invalid number";
+  }
+  return Json::JsonValue(v);
+}
+
+inline uint32_t load32(const char *p) {
+  uint32_t word;
+  std::memcpy(&word, p, sizeof(word));
+  return word;
+}
+
+// Matches one of "true", "false" or "null" at p with 32-bit word compares,
+// never reading past `end`, and on success leaves p past the trailing spaces.
+template <size_t N> inline bool matchLiteral(const char *&p, const char *end, const char (&literal)[N]) {
+  constexpr size_t len = N - 1;
+  static_assert(len == 4 || len == 5, "only true, false and null");
+  if (static_cast<size_t>(end - p) < len || load32(p + len - 4) != load32(literal + len - 4)) {
+    return false;
+  }
+  if (len == 5 && *p != *literal) {
+    return false;
+  }
+  p += len;
+  skipSpaces(p, end);
+  return true;
+}
+
+// Skips a string body from just past its opening quote to just past the
+// closing one. Escapes are stepped over, not checked.
+inline void skipString(const char *&p, const char *end, char quote) {
+  for (;;) {
+    p = simd::findQuoteOrEscape(p, end, quote);
+    if (p == end) {
+      throw "syntax error: unterminated string";
+    }
+    if (*p == quote) {
+      p += 1;
+      return;
+    }
+    p += 2; // backslash and the escaped byte
+    if (p > end) {
+      throw "syntax error: unterminated string";
+    }
+  }
+}
+
+// Kinds of the containers skipValue is inside: one bit per level for the
+// first 64, a vector past that.
+class NestingStack {
+public:
+  void push(bool object) {
+    if (depth < 64) {
+      bits = object ? bits | (uint64_t(1) << depth) : bits & ~(uint64_t(1) << depth);
+    } else {
+      deeper.push_back(object);
+    }
+    depth++;
+  }
+  // Pops a level; returns whether the stack is then empty.
+  bool pop() {
+    depth--;
+    if (depth >= 64) {
+      deeper.pop_back();
+    }
+    return depth == 0;
+  }
+  bool object() const { return depth <= 64 ? (bits >> (depth - 1)) & 1 : deeper.back(); }
+
+private:
+  uint64_t bits = 0;
+  size_t depth = 0;
+  std::vector<bool> deeper;
+};
+
+// Moves p from the first byte of a value to just past its last byte, without
+// parsing it. Containers are skipped by counting brackets, looking only at
+// brackets and quotes. A single quote opens a string where the parser reads
+// a value: anywhere in an array, and after the colon in an object. Where an
+// object expects a key it starts a bare key instead.
+inline void skipValue(const char *&p, const char *end) {
+  switch (*p) {
+  case '"': case '\'': {
+    char quote = *p++;
+    skipString(p, end, quote);
+    return;
+  }
+  case '{': case '[': {
+    NestingStack nesting;
+    for (;;) {
+      p = simd::findNesting(p, end);
+      if (p == end) {
+        throw "syntax error: unexpected end of input";
+      }
+      switch (*p++) {
+      case '{': case '[':
+        nesting.push(*(p - 1) == '{');
+        break;
+      case '}': case ']':
+        if (nesting.pop()) {
+          return;
+        }
+        break;
+      case '"':
+        skipString(p, end, '"');
+        break;
+      default: { // '\''
+        auto q = p - 1;
+        while (simd::isSpace(*(q - 1))) {
+          q--;
+        }
+        if (!nesting.object() || *(q - 1) == ':') {
+          skipString(p, end, '\'');
+        }
+      }
+      }
+    }
+  }
+  default: {
+    // Numbers and literals run to the next structural byte or space.
+    auto start = p;
+    while (p != end && !simd::isSpace(*p) && !simd::isStructural(*p)) {
+      p++;
+    }
+    if (p == start) {
+      throw "syntax error: value expected";
+    }
+  }
+  }
+}
+
+// Builds the DOM from parse events. Finished values wait on a stack until
+// their container closes; the engine reports how many elements it had, so
+// each array and object is allocated once at its final size. Strings that
+// lie within `input` are referred to in place; the rest (all of them when
+// `input` is empty) are copied into the arena. Keys go through `table`, when
+// given, so repeated keys share one instance. With `packNumbers`, arrays of
+// numbers of one kind are packed.
+class DomBuilder {
+public:
+  explicit DomBuilder(Json::Arena &arena, std::string_view input = std::string_view(),
+                      Json::KeyTable *table = nullptr, bool packNumbers = false)
+      : arena(arena), first(input.data()), last(input.data() + input.size()), table(table),
+        packNumbers(packNumbers) {}
+
+  void onNull() { values.push_back(Json::JsonValue::null()); }
+  void onBool(bool value) { values.push_back(Json::JsonValue(value)); }
+  void onNumber(long value) { values.push_back(Json::JsonValue(value)); }
+  void onNumber(double value) { values.push_back(Json::JsonValue(value)); }
+  void onString(std::string_view value) { values.push_back(Json::JsonValue(text(value))); }
+  void onKey(std::string_view key) { keys.push_back(table ? table->intern(key, inInput(key)) : text(key)); }
+  void onStartObject() {}
+  void onStartArray() {}
+
+  void onEndObject(size_t count) {
+    auto obj = arena.make<Json::JsonObject>(arena);
+    obj->reserve(count);
+    auto key = keys.end() - count;
+    for (auto value = values.end() - count; value != values.end(); ++value, ++key) {
+      obj->set(*key, *value);
+    }
+    keys.resize(keys.size() - count);
+    values.resize(values.size() - count);
+    values.push_back(obj);
+  }
+
+  void onEndArray(size_t count) {
+    auto arr = arena.make<Json::JsonArray>(arena);
+    arr->assign(values.data() + (values.size() - count), values.data() + values.size(), packNumbers);
+    values.resize(values.size() - count);
+    values.push_back(arr);
+  }
+
+  Json::JsonValue root() const { return values.empty() ? nullptr : values.back(); }
+
+private:
+  // Views into the input are kept; decoded strings live in a scratch buffer
+  // the next string overwrites, so they are copied.
+  bool inInput(std::string_view str) const {
+    return std::less_equal<const char *>()(first, str.data()) &&
+           std::less_equal<const char *>()(str.data() + str.size(), last);
+  }
+
+  std::string_view text(std::string_view str) { return inInput(str) ? str : arena.store(str); }
+
+  Json::Arena &arena;
+  const char *first;
+  const char *last;
+  Json::KeyTable *table;
+  bool packNumbers;
+  std::vector<Json::JsonValue> values;
+  std::vector<std::string_view> keys;
+};
+
+// Reports a number read by readNumber to `handler` with its integer or
+// floating callback.
+template <typename Handler> inline void emitNumber(Handler &handler, const Json::JsonValue &num) {
+  if (num.isInteger()) {
+    handler.onNumber(num.asInteger());
+  } else {
+    handler.onNumber(num.asFloating());
+  }
+}
+
+// The two-stage engine (json_structural.cpp).
+std::pair<Json::JsonValue, size_t> parseTwoStage(Json::Document &doc, std::string_view buff,
+                                                 const Json::ParseOptions &options);
+
+// Parses a large top-level array on several threads (json_parallel.cpp).
+// Returns {nullptr, 0} without consuming anything when the input is not an
+// array or is too small to split.
+std::pair<Json::JsonValue, size_t> parseArrayParallel(Json::Document &doc, std::string_view buff,
+                                                      const Json::ParseOptions &options);
+
+#endif //__JSON_DETAIL_HPP__
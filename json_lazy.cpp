@@ -0,0 +1,190 @@
+#include "json_detail.hpp"
+
+Json::Lazy::Lazy(std::string_view buff) {
+  const char *q = buff.data();
+  const char *last = buff.data() + buff.size();
+  skipSpaces(q, last);
+  if (q != last) {
+    p = q;
+    limit = last;
+  }
+}
+
+Json::Kind Json::Lazy::kind() const {
+  if (!p) {
+    throw "type error: no value";
+  }
+  switch (*p) {
+  case 'n': return Kind::Null;
+  case 't': case 'f': return Kind::Boolean;
+  case '"': case '\'': return Kind::String;
+  case '[': return Kind::Array;
+  case '{': return Kind::Object;
+  case '-': case '.':
+  case '0': case '1': case '2': case '3': case '4':
+  case '5': case '6': case '7': case '8': case '9':
+    return Kind::Number;
+  default:
+    throw "syntax error: value expected";
+  }
+}
+
+void Json::Lazy::expect(Kind kind, const char *error) const {
+  if (this->kind() != kind) {
+    throw error;
+  }
+}
+
+bool Json::Lazy::asBool() const {
+  auto q = p;
+  if (q && matchLiteral(q, limit, "true")) {
+    return true;
+  }
+  q = p;
+  if (q && matchLiteral(q, limit, "false")) {
+    return false;
+  }
+  throw "type error: boolean";
+}
+
+long Json::Lazy::asInteger() const {
+  expect(Kind::Number, "type error: integer");
+  auto q = p;
+  auto num = readNumber(q, limit);
+  if (!num.isInteger()) {
+    throw "type error: integer";
+  }
+  return num.asInteger();
+}
+
+double Json::Lazy::asFloating() const {
+  expect(Kind::Number, "type error: number");
+  auto q = p;
+  auto num = readNumber(q, limit);
+  return num.asFloating();
+}
+
+std::string_view Json::Lazy::asString(std::string &scratch) const {
+  expect(Kind::String, "type error: string");
+  auto q = p + 1;
+  return readString(q, limit, *p, scratch);
+}
+
+std::string Json::Lazy::asString() const {
+  std::string scratch;
+  return std::string(asString(scratch));
+}
+
+Json::Lazy Json::Lazy::find(std::string_view key) const {
+  expect(Kind::Object, "type error: object");
+  for (auto it = begin(); it != end(); ++it) {
+    if (it.key() == key) {
+      return *it;
+    }
+  }
+  return Lazy();
+}
+
+Json::Lazy Json::Lazy::at(size_t i) const {
+  expect(Kind::Array, "type error: array");
+  for (auto it = begin(); it != end(); ++it, --i) {
+    if (i == 0) {
+      return *it;
+    }
+  }
+  return Lazy();
+}
+
+size_t Json::Lazy::size() const {
+  size_t count = 0;
+  for (auto it = begin(); it != end(); ++it) {
+    count++;
+  }
+  return count;
+}
+
+Json::Lazy::Iterator Json::Lazy::begin() const {
+  auto kind = this->kind();
+  if (kind != Kind::Array && kind != Kind::Object) {
+    throw "type error: container";
+  }
+  return Iterator(p, limit, kind == Kind::Object);
+}
+
+Json::Lazy::Iterator Json::Lazy::end() const {
+  return Iterator(nullptr, limit, false);
+}
+
+std::string_view Json::Lazy::raw() const {
+  if (!p) {
+    return std::string_view();
+  }
+  auto q = p;
+  skipValue(q, limit);
+  return std::string_view(p, q - p);
+}
+
+Json::JsonValue Json::Lazy::materialize(Document &doc) const {
+  auto [value, _] = parse(doc, raw());
+  if (!value) {
+    throw "syntax error: value expected";
+  }
+  return value;
+}
+
+Json::Lazy::Iterator::Iterator(const char *p, const char *limit, bool object) : limit(limit), object(object) {
+  if (p) {
+    p += 1; // [ or {
+    skipSpaces(p, limit);
+    enter(p);
+  }
+}
+
+void Json::Lazy::Iterator::enter(const char *p) {
+  if (p == limit) {
+    throw "syntax error: unexpected end of input";
+  }
+  if (*p == (object ? '}' : ']')) {
+    value = nullptr;
+    return;
+  }
+  if (object) {
+    decoded = false;
+    if (*p == '"') {
+      p += 1;
+      name = readString(p, limit, '"', scratch);
+      decoded = (name.data() == scratch.data());
+    } else {
+      // Lenient bare key, as in the parser.
+      auto start = p;
+      p = simd::findStructural(p, limit);
+      auto last = p;
+      while (last != start && simd::isSpace(*(last - 1))) {
+        last--;
+      }
+      name = std::string_view(start, last - start);
+    }
+    skipSpaces(p, limit);
+    if (p == limit || *p != ':') {
+      throw "syntax error: colon expected";
+    }
+    p += 1;
+    skipSpaces(p, limit);
+    if (p == limit) {
+      throw "syntax error: unexpected end of input";
+    }
+  }
+  value = p;
+}
+
+Json::Lazy::Iterator &Json::Lazy::Iterator::operator++() {
+  auto p = value;
+  skipValue(p, limit);
+  skipSpaces(p, limit);
+  if (p != limit && *p == ',') {
+    p += 1;
+    skipSpaces(p, limit);
+  }
+  enter(p);
+  return *this;
+}
@@ -0,0 +1,191 @@
+#include "json_detail.hpp"
+#include <exception>
+#include <thread>
+
+namespace {
+
+// Below this many bytes per thread, starting threads costs more than it
+// saves.
+constexpr size_t minSpan = 1 << 20;
+
+unsigned threadCount(const Json::ParseOptions &options, size_t size) {
+  size_t threads = options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+  return static_cast<unsigned>(std::min(threads, size / minSpan + 1));
+}
+
+// Parses the lines of `buff` in order into `doc`.
+void parseSpan(Json::Document &doc, std::string_view buff, const Json::ParseOptions &options,
+               std::vector<Json::JsonValue> &values) {
+  const char *p = buff.data();
+  const char *end = buff.data() + buff.size();
+  while (p != end) {
+    auto eol = static_cast<const char *>(std::memchr(p, '\n', end - p));
+    auto next = eol ? eol + 1 : end;
+    auto start = p;
+    skipSpaces(start, next);
+    if (start != next) {
+      std::string_view line(start, (eol ? eol : end) - start);
+      auto [value, used] = Json::parse(doc, line, options);
+      if (!value) {
+        throw "syntax error: value expected";
+      }
+      // `used` covers trailing spaces, so anything left is a second value or
+      // garbage.
+      if (used != line.size()) {
+        throw "syntax error: end of line expected";
+      }
+      values.push_back(value);
+    }
+    p = next;
+  }
+}
+
+// Runs `parse(doc, span, values)` for every span on a thread of its own,
+// each into a fresh Document, and returns the values of all spans in order.
+// The Documents' arenas move to `doc`; the first error in span order is
+// rethrown.
+template <typename Parse>
+std::vector<Json::JsonValue> parseSpans(Json::Document &doc, const std::vector<std::string_view> &spans, Parse parse) {
+  std::vector<Json::Document> docs(spans.size());
+  std::vector<std::vector<Json::JsonValue>> results(spans.size());
+  std::vector<std::exception_ptr> errors(spans.size());
+  std::vector<std::thread> workers;
+  for (size_t i = 0; i < spans.size(); i++) {
+    workers.emplace_back([&, i]() {
+      try {
+        parse(docs[i], spans[i], results[i]);
+      } catch (...) {
+        errors[i] = std::current_exception();
+      }
+    });
+  }
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  for (auto &error : errors) {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+
+  size_t total = 0;
+  for (auto &result : results) {
+    total += result.size();
+  }
+  std::vector<Json::JsonValue> values;
+  values.reserve(total);
+  for (size_t i = 0; i < spans.size(); i++) {
+    values.insert(values.end(), results[i].begin(), results[i].end());
+    doc.arenas.push_back(std::move(docs[i].arena));
+  }
+  return values;
+}
+
+// Parses the comma-separated elements of an array body in order into `doc`.
+void parseElements(Json::Document &doc, std::string_view buff, const Json::ParseOptions &options,
+                   std::vector<Json::JsonValue> &values) {
+  const char *p = buff.data();
+  const char *end = buff.data() + buff.size();
+  while (p != end) {
+    auto [value, used] = Json::parse(doc, std::string_view(p, end - p), options);
+    if (!value) {
+      throw "syntax error: value expected";
+    }
+    values.push_back(value);
+    p += used;
+    if (p != end && *p == ',') {
+      p += 1;
+      skipSpaces(p, end);
+    }
+  }
+}
+
+} // namespace
+
+std::vector<Json::JsonValue> Json::parseLines(Document &doc, std::string_view buff, const ParseOptions &options) {
+  // Records are parsed one thread each.
+  ParseOptions sequential = options;
+  sequential.threads = 1;
+  std::vector<JsonValue> values;
+  auto threads = threadCount(options, buff.size());
+  if (threads == 1) {
+    parseSpan(doc, buff, sequential, values);
+    doc.root = nullptr;
+    return values;
+  }
+
+  // Equal spans, each extended to the end of the line it stops in.
+  std::vector<std::string_view> spans;
+  size_t begin = 0;
+  for (unsigned i = 1; i <= threads; i++) {
+    size_t cut = buff.size() * i / threads;
+    if (cut < begin) {
+      cut = begin;
+    }
+    auto eol = i == threads ? nullptr : std::memchr(buff.data() + cut, '\n', buff.size() - cut);
+    cut = eol ? static_cast<const char *>(eol) - buff.data() + 1 : buff.size();
+    spans.push_back(buff.substr(begin, cut - begin));
+    begin = cut;
+  }
+
+  values = parseSpans(doc, spans, [&sequential](Document &doc, std::string_view span, std::vector<JsonValue> &values) {
+    parseSpan(doc, span, sequential, values);
+  });
+  doc.root = nullptr;
+  return values;
+}
+
+std::pair<Json::JsonValue, size_t> parseArrayParallel(Json::Document &doc, std::string_view buff,
+                                                      const Json::ParseOptions &options) {
+  auto threads = threadCount(options, buff.size());
+  const char *p = buff.data();
+  const char *end = buff.data() + buff.size();
+  skipSpaces(p, end);
+  if (threads == 1 || p == end || *p != '[') {
+    return {nullptr, 0};
+  }
+  if (options.maxDepth == 0) {
+    throw "syntax error: nesting too deep";
+  }
+
+  // Pre-scan: step over the elements without parsing them, starting a new
+  // span at the first element past each equal share of the input.
+  std::vector<std::string_view> spans;
+  const size_t share = buff.size() / threads;
+  p += 1; // [
+  skipSpaces(p, end);
+  const char *start = p;
+  size_t next = (p - buff.data()) + share;
+  while (p != end && *p != ']') {
+    if (static_cast<size_t>(p - buff.data()) >= next) {
+      spans.emplace_back(start, p - start);
+      start = p;
+      next = (p - buff.data()) + share;
+    }
+    skipValue(p, end);
+    skipSpaces(p, end);
+    if (p != end && *p == ',') {
+      p += 1;
+      skipSpaces(p, end);
+    }
+  }
+  if (p == end) {
+    throw "syntax error: unexpected end of input";
+  }
+  spans.emplace_back(start, p - start);
+  p += 1; // ]
+  skipSpaces(p, end);
+
+  // The elements sit one level below the root array.
+  Json::ParseOptions sequential = options;
+  sequential.threads = 1;
+  sequential.maxDepth = options.maxDepth - 1;
+  auto values = parseSpans(doc, spans, [&sequential](Json::Document &doc, std::string_view span,
+                                                     std::vector<Json::JsonValue> &values) {
+    parseElements(doc, span, sequential, values);
+  });
+  auto arr = doc.arena->make<Json::JsonArray>(*doc.arena);
+  arr->assign(values.data(), values.data() + values.size(), options.packNumbers);
+  doc.root = arr;
+  return {arr, static_cast<size_t>(p - buff.data())};
+}
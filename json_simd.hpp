@@ -0,0 +1,301 @@
+#ifndef __JSON_SIMD_HPP__
+#define __JSON_SIMD_HPP__
+
+// Byte-scanning kernels shared by the parsers. Each one has an AVX2 and an
+// SSE2 body picked at compile time plus a scalar loop that also handles the
+// tail, so no kernel ever loads past `end`.
+
+#include <cstdint>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace simd {
+
+inline bool isSpace(char ch) {
+  return ch == ' ' || ch == '\n' || ch == '\r' || ch == '\t';
+}
+
+inline bool isStructural(char ch) {
+  return ch == '{' || ch == '}' || ch == '[' || ch == ']' || ch == ':' || ch == ',' || ch == '"';
+}
+
+#if defined(__AVX2__)
+inline __m256i spaceMask(__m256i chunk) {
+  auto sp = _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(' '));
+  auto nl = _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('\n'));
+  auto cr = _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('\r'));
+  auto tab = _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('\t'));
+  return _mm256_or_si256(_mm256_or_si256(sp, nl), _mm256_or_si256(cr, tab));
+}
+
+inline __m256i structuralMask(__m256i chunk) {
+  auto curly = _mm256_or_si256(_mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('{')),
+                               _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('}')));
+  auto square = _mm256_or_si256(_mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('[')),
+                                _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(']')));
+  auto colon = _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(':'));
+  auto comma = _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(','));
+  auto quote = _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('"'));
+  return _mm256_or_si256(_mm256_or_si256(curly, square), _mm256_or_si256(_mm256_or_si256(colon, comma), quote));
+}
+#endif
+
+#if defined(__SSE2__)
+inline __m128i spaceMask(__m128i chunk) {
+  auto sp = _mm_cmpeq_epi8(chunk, _mm_set1_epi8(' '));
+  auto nl = _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\n'));
+  auto cr = _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\r'));
+  auto tab = _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\t'));
+  return _mm_or_si128(_mm_or_si128(sp, nl), _mm_or_si128(cr, tab));
+}
+
+inline __m128i structuralMask(__m128i chunk) {
+  auto curly = _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('{')), _mm_cmpeq_epi8(chunk, _mm_set1_epi8('}')));
+  auto square = _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('[')), _mm_cmpeq_epi8(chunk, _mm_set1_epi8(']')));
+  auto colon = _mm_cmpeq_epi8(chunk, _mm_set1_epi8(':'));
+  auto comma = _mm_cmpeq_epi8(chunk, _mm_set1_epi8(','));
+  auto quote = _mm_cmpeq_epi8(chunk, _mm_set1_epi8('"'));
+  return _mm_or_si128(_mm_or_si128(curly, square), _mm_or_si128(_mm_or_si128(colon, comma), quote));
+}
+#endif
+
+// First byte in [p, end) that is not JSON whitespace, or `end`.
+inline const char *skipSpaces(const char *p, const char *end) {
+  // Compact documents have no or a single separating space, so settle those
+  // before paying for a vector load.
+  if (p == end || !isSpace(*p)) {
+    return p;
+  }
+  p += 1;
+  if (p == end || !isSpace(*p)) {
+    return p;
+  }
+#if defined(__AVX2__)
+  while (end - p >= 32) {
+    auto chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    auto mask = ~static_cast<uint32_t>(_mm256_movemask_epi8(spaceMask(chunk)));
+    if (mask) {
+      return p + __builtin_ctz(mask);
+    }
+    p += 32;
+  }
+#endif
+#if defined(__SSE2__)
+  while (end - p >= 16) {
+    auto chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    auto mask = ~static_cast<uint32_t>(_mm_movemask_epi8(spaceMask(chunk))) & 0xffff;
+    if (mask) {
+      return p + __builtin_ctz(mask);
+    }
+    p += 16;
+  }
+#endif
+  while (p != end && isSpace(*p)) {
+    p++;
+  }
+  return p;
+}
+
+// First structural character ({ } [ ] : , or a double quote) in [p, end),
+// or `end`.
+inline const char *findStructural(const char *p, const char *end) {
+#if defined(__AVX2__)
+  while (end - p >= 32) {
+    auto chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    auto mask = static_cast<uint32_t>(_mm256_movemask_epi8(structuralMask(chunk)));
+    if (mask) {
+      return p + __builtin_ctz(mask);
+    }
+    p += 32;
+  }
+#endif
+#if defined(__SSE2__)
+  while (end - p >= 16) {
+    auto chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    auto mask = static_cast<uint32_t>(_mm_movemask_epi8(structuralMask(chunk)));
+    if (mask) {
+      return p + __builtin_ctz(mask);
+    }
+    p += 16;
+  }
+#endif
+  while (p != end && !isStructural(*p)) {
+    p++;
+  }
+  return p;
+}
+
+// First `quote` or backslash in [p, end), or `end`. Everything before it is
+// plain string content that can be copied as a block.
+inline const char *findQuoteOrEscape(const char *p, const char *end, char quote) {
+#if defined(__AVX2__)
+  const auto quotes = _mm256_set1_epi8(quote);
+  const auto slashes = _mm256_set1_epi8('\\');
+  while (end - p >= 32) {
+    auto chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    auto hits = _mm256_or_si256(_mm256_cmpeq_epi8(chunk, quotes), _mm256_cmpeq_epi8(chunk, slashes));
+    auto mask = static_cast<uint32_t>(_mm256_movemask_epi8(hits));
+    if (mask) {
+      return p + __builtin_ctz(mask);
+    }
+    p += 32;
+  }
+#endif
+#if defined(__SSE2__)
+  {
+    const auto quotes = _mm_set1_epi8(quote);
+    const auto slashes = _mm_set1_epi8('\\');
+    while (end - p >= 16) {
+      auto chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+      auto hits = _mm_or_si128(_mm_cmpeq_epi8(chunk, quotes), _mm_cmpeq_epi8(chunk, slashes));
+      auto mask = static_cast<uint32_t>(_mm_movemask_epi8(hits));
+      if (mask) {
+        return p + __builtin_ctz(mask);
+      }
+      p += 16;
+    }
+  }
+#endif
+  while (p != end && *p != quote && *p != '\\') {
+    p++;
+  }
+  return p;
+}
+
+#if defined(__AVX2__)
+inline __m256i nestingMask(__m256i chunk) {
+  auto curly = _mm256_or_si256(_mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('{')),
+                               _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('}')));
+  auto square = _mm256_or_si256(_mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('[')),
+                                _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(']')));
+  auto quotes = _mm256_or_si256(_mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('"')),
+                                _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('\'')));
+  return _mm256_or_si256(_mm256_or_si256(curly, square), quotes);
+}
+#endif
+
+#if defined(__SSE2__)
+inline __m128i nestingMask(__m128i chunk) {
+  auto curly = _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('{')), _mm_cmpeq_epi8(chunk, _mm_set1_epi8('}')));
+  auto square = _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('[')), _mm_cmpeq_epi8(chunk, _mm_set1_epi8(']')));
+  auto quotes = _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('"')), _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\'')));
+  return _mm_or_si128(_mm_or_si128(curly, square), quotes);
+}
+#endif
+
+// First bracket or quote ({ } [ ] " ') in [p, end), or `end`: the only bytes
+// that matter when skipping over a nested value.
+inline const char *findNesting(const char *p, const char *end) {
+#if defined(__AVX2__)
+  while (end - p >= 32) {
+    auto chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    auto mask = static_cast<uint32_t>(_mm256_movemask_epi8(nestingMask(chunk)));
+    if (mask) {
+      return p + __builtin_ctz(mask);
+    }
+    p += 32;
+  }
+#endif
+#if defined(__SSE2__)
+  while (end - p >= 16) {
+    auto chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    auto mask = static_cast<uint32_t>(_mm_movemask_epi8(nestingMask(chunk)));
+    if (mask) {
+      return p + __builtin_ctz(mask);
+    }
+    p += 16;
+  }
+#endif
+  while (p != end && *p != '{' && *p != '}' && *p != '[' && *p != ']' && *p != '"' && *p != '\'') {
+    p++;
+  }
+  return p;
+}
+
+// Per-byte classification of one 64-byte block, one bit per byte with bit i
+// standing for p[i].
+struct Block {
+  uint64_t quote;     // double quote
+  uint64_t backslash; // backslash
+  uint64_t op;        // { } [ ] : ,
+  uint64_t space;     // JSON whitespace
+};
+
+#if defined(__AVX2__)
+inline uint64_t movemask64(__m256i lo, __m256i hi) {
+  return static_cast<uint32_t>(_mm256_movemask_epi8(lo)) |
+         (static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(hi))) << 32);
+}
+#elif defined(__SSE2__)
+inline uint64_t movemask64(__m128i a, __m128i b, __m128i c, __m128i d) {
+  return static_cast<uint64_t>(_mm_movemask_epi8(a)) | (static_cast<uint64_t>(_mm_movemask_epi8(b)) << 16) |
+         (static_cast<uint64_t>(_mm_movemask_epi8(c)) << 32) | (static_cast<uint64_t>(_mm_movemask_epi8(d)) << 48);
+}
+#endif
+
+// Classifies the 64 bytes at p, which must all be readable.
+inline Block classify(const char *p) {
+  Block block;
+#if defined(__AVX2__)
+  auto lo = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+  auto hi = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + 32));
+  auto eq = [&](char ch) {
+    auto v = _mm256_set1_epi8(ch);
+    return movemask64(_mm256_cmpeq_epi8(lo, v), _mm256_cmpeq_epi8(hi, v));
+  };
+  block.quote = eq('"');
+  block.backslash = eq('\\');
+  block.op = movemask64(structuralMask(lo), structuralMask(hi)) & ~block.quote;
+  block.space = movemask64(spaceMask(lo), spaceMask(hi));
+#elif defined(__SSE2__)
+  __m128i v[4];
+  for (int i = 0; i < 4; i++) {
+    v[i] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 16 * i));
+  }
+  auto eq = [&](char ch) {
+    auto c = _mm_set1_epi8(ch);
+    return movemask64(_mm_cmpeq_epi8(v[0], c), _mm_cmpeq_epi8(v[1], c), _mm_cmpeq_epi8(v[2], c),
+                      _mm_cmpeq_epi8(v[3], c));
+  };
+  block.quote = eq('"');
+  block.backslash = eq('\\');
+  block.op = movemask64(structuralMask(v[0]), structuralMask(v[1]), structuralMask(v[2]), structuralMask(v[3])) &
+             ~block.quote;
+  block.space = movemask64(spaceMask(v[0]), spaceMask(v[1]), spaceMask(v[2]), spaceMask(v[3]));
+#else
+  block = Block{0, 0, 0, 0};
+  for (int i = 0; i < 64; i++) {
+    uint64_t bit = uint64_t(1) << i;
+    char ch = p[i];
+    block.quote |= (ch == '"') ? bit : 0;
+    block.backslash |= (ch == '\\') ? bit : 0;
+    block.op |= (isStructural(ch) && ch != '"') ? bit : 0;
+    block.space |= isSpace(ch) ? bit : 0;
+  }
+#endif
+  return block;
+}
+
+// Bit i of the result is the XOR of bits 0..i of `bits`; applied to quote
+// positions it marks every byte from an opening quote up to, but not
+// including, its closing one.
+inline uint64_t prefixXor(uint64_t bits) {
+#if defined(__PCLMUL__)
+  auto all = _mm_set1_epi8(static_cast<char>(0xff));
+  return static_cast<uint64_t>(_mm_cvtsi128_si64(_mm_clmulepi64_si128(_mm_set_epi64x(0, bits), all, 0)));
+#else
+  bits ^= bits << 1;
+  bits ^= bits << 2;
+  bits ^= bits << 4;
+  bits ^= bits << 8;
+  bits ^= bits << 16;
+  bits ^= bits << 32;
+  return bits;
+#endif
+}
+
+} // namespace simd
+
+#endif //__JSON_SIMD_HPP__
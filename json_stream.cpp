@@ -0,0 +1,287 @@
+#include "json_detail.hpp"
+
+namespace {
+
+// Whether the string body starting at p has its closing quote before `end`.
+bool closes(const char *p, const char *end, char quote) {
+  for (;;) {
+    p = simd::findQuoteOrEscape(p, end, quote);
+    if (p == end) {
+      return false;
+    }
+    if (*p == quote) {
+      return true;
+    }
+    if (end - p < 2) {
+      return false;
+    }
+    p += 2; // backslash and the escaped byte
+  }
+}
+
+// End of the number or literal at p: the next space or structural byte.
+const char *wordEnd(const char *p, const char *end) {
+  while (p != end && !simd::isSpace(*p) && !simd::isStructural(*p)) {
+    p++;
+  }
+  return p;
+}
+
+} // namespace
+
+void Json::StreamParser::feed(std::string_view chunk) {
+  // Complete a carried-over token by scanning only the new bytes for its
+  // end, so a token spanning many chunks costs time linear in its length; it
+  // is parsed once, when whole.
+  while (!pending.empty() && !chunk.empty()) {
+    auto need = tokenEnd(chunk);
+    if (need == std::string_view::npos) {
+      pending.append(chunk.data(), chunk.size());
+      return;
+    }
+    pending.append(chunk.data(), need);
+    chunk.remove_prefix(need);
+    pending.erase(0, run(pending, false));
+    carry();
+  }
+  if (pending.empty()) {
+    pending.assign(chunk.substr(run(chunk, false)));
+    carry();
+  }
+}
+
+bool Json::StreamParser::finish() {
+  if (!pending.empty()) {
+    run(pending, true);
+    pending.clear();
+  }
+  if (state == State::Done) {
+    return true;
+  }
+  if (state == State::NoValue || (state == State::Value && frames.empty())) {
+    return false;
+  }
+  throw "syntax error: unexpected end of input";
+}
+
+// Sets up the scan state for the token `pending` starts with, scanning what
+// there is of it.
+void Json::StreamParser::carry() {
+  if (pending.empty()) {
+    return;
+  }
+  quote = 0;
+  escaped = false;
+  if (pending[0] == '"' || (pending[0] == '\'' && state != State::Key)) {
+    quote = pending[0];
+    tokenEnd(std::string_view(pending).substr(1));
+  }
+}
+
+// How many bytes of `data` complete the carried-over token: through the
+// closing quote of a string, or through the byte that ends a number, literal
+// or bare key. npos if it does not end within `data`.
+size_t Json::StreamParser::tokenEnd(std::string_view data) {
+  const char *p = data.data();
+  const char *end = data.data() + data.size();
+  if (!quote) {
+    auto stop = state == State::Key ? simd::findStructural(p, end) : wordEnd(p, end);
+    return stop == end ? std::string_view::npos : stop - p + 1;
+  }
+  if (escaped) {
+    if (p == end) {
+      return std::string_view::npos;
+    }
+    p += 1;
+    escaped = false;
+  }
+  for (;;) {
+    p = simd::findQuoteOrEscape(p, end, quote);
+    if (p == end) {
+      return std::string_view::npos;
+    }
+    if (*p == quote) {
+      return p + 1 - data.data();
+    }
+    if (end - p < 2) {
+      escaped = true;
+      return std::string_view::npos;
+    }
+    p += 2; // backslash and the escaped byte
+  }
+}
+
+// Consumes complete tokens from `data` and returns how many bytes were used.
+// Unless `final`, it stops at the start of a token that may continue in the
+// next chunk.
+size_t Json::StreamParser::run(std::string_view data, bool final) {
+  const char *p = data.data();
+  const char *end = data.data() + data.size();
+  while (state != State::Done && state != State::NoValue) {
+    skipSpaces(p, end);
+    if (p == end) {
+      break;
+    }
+    auto start = p;
+    switch (state) {
+    case State::Element:
+      if (*p == ']') {
+        p += 1;
+        handler.onEndArray(frames.back().count);
+        frames.pop_back();
+        completed();
+        break;
+      }
+      // Fall through.
+    case State::Value:
+      if (!value(p, end, final)) {
+        return start - data.data();
+      }
+      break;
+    case State::Key:
+      if (*p == '}') {
+        p += 1;
+        handler.onEndObject(frames.back().count);
+        frames.pop_back();
+        completed();
+        break;
+      }
+      if (!key(p, end, final)) {
+        return start - data.data();
+      }
+      state = State::Colon;
+      break;
+    case State::Colon:
+      if (*p != ':') {
+        throw "syntax error: colon expected";
+      }
+      p += 1;
+      state = State::Value;
+      break;
+    case State::Next:
+      // Commas are optional, as in the single-pass parser.
+      if (*p == ',') {
+        p += 1;
+      }
+      state = frames.back().object ? State::Key : State::Element;
+      break;
+    case State::Done: case State::NoValue:
+      break;
+    }
+  }
+  return state == State::Done || state == State::NoValue ? data.size() : p - data.data();
+}
+
+// Reads the value at p, or returns false with p unchanged when it may
+// continue past `end`.
+bool Json::StreamParser::value(const char *&p, const char *end, bool final) {
+  switch (*p) {
+  case '"': case '\'': {
+    char quote = *p;
+    if (!final && !closes(p + 1, end, quote)) {
+      return false;
+    }
+    p += 1;
+    handler.onString(readString(p, end, quote, scratch));
+    completed();
+    return true;
+  }
+  case '{': case '[':
+    open(*p == '{');
+    p += 1;
+    return true;
+  }
+
+  auto last = wordEnd(p, end);
+  if (last == end && !final) {
+    return false;
+  }
+  switch (*p) {
+  case '-': case '.':
+  case '0': case '1': case '2': case '3': case '4':
+  case '5': case '6': case '7': case '8': case '9':
+    emitNumber(handler, readNumber(p, last));
+    break;
+  case 't':
+    if (!matchLiteral(p, last, "true")) {
+      return noValue();
+    }
+    handler.onBool(true);
+    break;
+  case 'f':
+    if (!matchLiteral(p, last, "false")) {
+      return noValue();
+    }
+    handler.onBool(false);
+    break;
+  case 'n':
+    if (!matchLiteral(p, last, "null")) {
+      return noValue();
+    }
+    handler.onNull();
+    break;
+  default:
+    return noValue();
+  }
+  completed();
+  return true;
+}
+
+// A root that is not a value ends the input, as in parse(Handler&, ...);
+// inside a container it is an error.
+bool Json::StreamParser::noValue() {
+  if (!frames.empty()) {
+    throw "syntax error: value expected";
+  }
+  state = State::NoValue;
+  return true;
+}
+
+// Reads the key at p, or returns false with p unchanged when it may continue
+// past `end`.
+bool Json::StreamParser::key(const char *&p, const char *end, bool final) {
+  if (*p == '"') {
+    if (!final && !closes(p + 1, end, '"')) {
+      return false;
+    }
+    p += 1;
+    handler.onKey(readString(p, end, '"', scratch));
+    return true;
+  }
+  // Lenient unquoted key, up to the colon.
+  auto start = p;
+  auto stop = simd::findStructural(p, end);
+  if (stop == end && !final) {
+    return false;
+  }
+  p = stop;
+  while (stop != start && simd::isSpace(*(stop - 1))) {
+    stop--;
+  }
+  handler.onKey(std::string_view(start, stop - start));
+  return true;
+}
+
+// Starts an array or object, within the depth limit.
+void Json::StreamParser::open(bool object) {
+  if (frames.size() == maxDepth) {
+    throw "syntax error: nesting too deep";
+  }
+  if (object) {
+    handler.onStartObject();
+  } else {
+    handler.onStartArray();
+  }
+  frames.push_back({object, 0});
+  state = object ? State::Key : State::Element;
+}
+
+// Counts a finished value towards its container, or ends the document.
+void Json::StreamParser::completed() {
+  if (frames.empty()) {
+    state = State::Done;
+  } else {
+    frames.back().count += 1;
+    state = State::Next;
+  }
+}
@@ -0,0 +1,63 @@
+#include "json_structural.hpp"
+
+void indexStructurals(std::string_view buff, std::vector<uint32_t> &index) {
+  if (buff.size() > std::numeric_limits<uint32_t>::max()) {
+    throw "input too large";
+  }
+  const uint64_t even = 0x5555555555555555ULL;
+  uint64_t prevEscaped = 0;  // first byte of next block is escaped
+  uint64_t prevInString = 0; // all ones while a string spans the boundary
+  uint64_t prevScalar = 0;   // last byte of previous block was a scalar
+
+  index.clear();
+  index.reserve(buff.size() / 8 + 16);
+  for (size_t pos = 0; pos < buff.size(); pos += 64) {
+    char padded[64];
+    const char *block = buff.data() + pos;
+    if (buff.size() - pos < 64) {
+      std::memset(padded, ' ', sizeof(padded));
+      std::memcpy(padded, block, buff.size() - pos);
+      block = padded;
+    }
+    auto masks = simd::classify(block);
+
+    // A character is escaped when it follows an odd-length run of
+    // backslashes; runs starting on odd bits carry into the next even bit.
+    uint64_t backslash = masks.backslash & ~prevEscaped;
+    uint64_t followsEscape = (backslash << 1) | prevEscaped;
+    uint64_t oddStarts = backslash & ~even & ~followsEscape;
+    uint64_t evenSequences;
+    prevEscaped = __builtin_add_overflow(oddStarts, backslash, &evenSequences);
+    uint64_t escaped = (even ^ (evenSequences << 1)) & followsEscape;
+
+    uint64_t quote = masks.quote & ~escaped;
+    uint64_t inString = simd::prefixXor(quote) ^ prevInString;
+    prevInString = static_cast<uint64_t>(static_cast<int64_t>(inString) >> 63);
+    // String bodies and closing quotes; opening quotes stay structural.
+    uint64_t stringTail = inString ^ quote;
+
+    uint64_t scalar = ~(masks.op | masks.space);
+    uint64_t nonQuoteScalar = scalar & ~quote;
+    uint64_t followsScalar = (nonQuoteScalar << 1) | prevScalar;
+    prevScalar = nonQuoteScalar >> 63;
+
+    uint64_t structurals = (masks.op | (scalar & ~followsScalar)) & ~stringTail;
+    while (structurals) {
+      index.push_back(static_cast<uint32_t>(pos + __builtin_ctzll(structurals)));
+      structurals &= structurals - 1;
+    }
+  }
+  // An unterminated string is reported by stage 2 if it ever reads it; text
+  // after the root value is ignored, as in the single-pass parser.
+}
+
+std::pair<Json::JsonValue, size_t> parseTwoStage(Json::Document &doc, std::string_view buff,
+                                                 const Json::ParseOptions &options) {
+  std::vector<uint32_t> index;
+  indexStructurals(buff, index);
+  DomBuilder builder(*doc.arena, options.borrowStrings ? buff : std::string_view(),
+                     options.internKeys ? &doc.keys : nullptr, options.packNumbers);
+  auto consumed = Walker<DomBuilder>(buff, index, builder, options.maxDepth).run();
+  doc.root = consumed ? builder.root() : nullptr;
+  return {doc.root, consumed};
+}
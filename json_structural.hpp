@@ -0,0 +1,231 @@
+#ifndef __JSON_STRUCTURAL_HPP__
+#define __JSON_STRUCTURAL_HPP__
+
+// Two-stage engine. Stage 1 classifies the input 64 bytes at a time into a
+// flat index of structural positions: every { } [ ] : , outside strings plus
+// the first byte of each string, number and literal. Stage 2 walks that
+// index with an explicit container stack and reports the values to a
+// handler, reading each scalar with the same token readers as the
+// single-pass parser. Internal to the library.
+//
+// Reading scalars again from the text means stage 2 does about the work of
+// the single-pass parser on its own, so the engine as a whole is slower than
+// it; using the index to cut that work (string ends, say) is still to do.
+
+#include "json_detail.hpp"
+
+// Stage 1. Replaces the contents of `index` with the offset of every
+// structural position in `buff`.
+void indexStructurals(std::string_view buff, std::vector<uint32_t> &index);
+
+// Stage 2. Walks the index and reports values to `handler`. Scalars are read
+// from the input text; index entries a scalar swallowed (the words of a
+// lenient bare key, say) are skipped afterwards.
+//
+// The index only knows double-quoted strings, so lenient input can leave it
+// out of step with the text: a single-quoted string containing '"' flips its
+// idea of what is inside a string, and a token glued to a scalar ("12x",
+// "nullnull") has no entry of its own. When the next entry after a scalar is
+// not where the text says the next token starts, the walker finishes the
+// document reading tokens straight from the text, as the single-pass parser
+// does.
+template <typename Handler> class Walker {
+public:
+  Walker(std::string_view buff, const std::vector<uint32_t> &index, Handler &handler, size_t maxDepth)
+      : buff(buff.data()), end(buff.data() + buff.size()), idx(index.data()), last(index.data() + index.size()),
+        handler(handler), maxDepth(maxDepth) {}
+
+  // Returns the offset just past the root value, or 0 when the input does
+  // not start with a value.
+  size_t run();
+
+private:
+  struct Frame {
+    bool object;
+    size_t count;
+  };
+
+  // Cursor over the tokens: the current index entry, or `cur` once the
+  // walker has left the index.
+  bool atEnd() const { return cur ? cur == end : idx == last; }
+  const char *at() const { return cur ? cur : buff + *idx; }
+  char peek() const { return atEnd() ? '\0' : *at(); }
+
+  // Steps over a one-byte token.
+  void advance() {
+    if (cur) {
+      cur += 1;
+      skipSpaces(cur, end);
+    } else {
+      ++idx;
+    }
+  }
+
+  // Moves to the first token at or after `p`, which must be past spaces.
+  void skipConsumed(const char *p) {
+    if (cur) {
+      cur = p;
+      return;
+    }
+    while (idx != last && buff + *idx < p) {
+      ++idx;
+    }
+    if (p != end && (idx == last || buff + *idx != p)) {
+      cur = p;
+    }
+  }
+
+  bool scalar();
+  void key();
+  void open(bool object);
+
+  const char *buff;
+  const char *end;
+  const uint32_t *idx;
+  const uint32_t *last;
+  const char *cur = nullptr;
+  Handler &handler;
+  size_t maxDepth;
+  std::vector<Frame> frames;
+  std::string scratch;
+};
+
+// Reads the scalar at the cursor; false if there is none.
+template <typename Handler> bool Walker<Handler>::scalar() {
+  const char *p = at();
+  switch (*p) {
+  case '"': case '\'': {
+    char quote = *p++;
+    handler.onString(readString(p, end, quote, scratch));
+    break;
+  }
+  case '-': case '.':
+  case '0': case '1': case '2': case '3': case '4':
+  case '5': case '6': case '7': case '8': case '9':
+    emitNumber(handler, readNumber(p, end));
+    break;
+  case 't':
+    if (!matchLiteral(p, end, "true")) {
+      return false;
+    }
+    handler.onBool(true);
+    break;
+  case 'f':
+    if (!matchLiteral(p, end, "false")) {
+      return false;
+    }
+    handler.onBool(false);
+    break;
+  case 'n':
+    if (!matchLiteral(p, end, "null")) {
+      return false;
+    }
+    handler.onNull();
+    break;
+  default:
+    return false;
+  }
+  skipSpaces(p, end);
+  skipConsumed(p);
+  return true;
+}
+
+template <typename Handler> void Walker<Handler>::key() {
+  const char *p = at();
+  if (*p == '"') {
+    p += 1;
+    handler.onKey(readString(p, end, '"', scratch));
+  } else {
+    // Lenient unquoted key, up to the colon; a single quote is part of it,
+    // as in the single-pass parser.
+    auto start = p;
+    p = simd::findStructural(p, end);
+    auto last = p;
+    while (last != start && simd::isSpace(*(last - 1))) {
+      last--;
+    }
+    handler.onKey(std::string_view(start, last - start));
+  }
+  skipSpaces(p, end);
+  if (p == end || *p != ':') {
+    throw "syntax error: colon expected";
+  }
+  p += 1;
+  skipSpaces(p, end);
+  skipConsumed(p);
+}
+
+template <typename Handler> void Walker<Handler>::open(bool object) {
+  if (frames.size() == maxDepth) {
+    throw "syntax error: nesting too deep";
+  }
+  advance();
+  if (object) {
+    handler.onStartObject();
+  } else {
+    handler.onStartArray();
+  }
+  frames.push_back({object, 0});
+}
+
+template <typename Handler> size_t Walker<Handler>::run() {
+  if (atEnd()) {
+    return 0;
+  }
+
+  // Each round reads one value, then closes every container that ends right
+  // after it. Commas between elements are optional, as in the single-pass
+  // parser.
+  auto done = [this]() -> size_t { return (atEnd() ? end : at()) - buff; };
+  while (true) {
+    if (atEnd()) {
+      throw "syntax error: unexpected end of input";
+    }
+    switch (peek()) {
+    case '{': case '[':
+      open(peek() == '{');
+      break;
+    default:
+      if (!scalar()) {
+        if (frames.empty()) {
+          return 0;
+        }
+        throw "syntax error: value expected";
+      }
+      if (frames.empty()) {
+        return done();
+      }
+      frames.back().count += 1;
+      if (peek() == ',') {
+        advance();
+      }
+    }
+
+    while (peek() == (frames.back().object ? '}' : ']')) {
+      advance();
+      auto frame = frames.back();
+      frames.pop_back();
+      if (frame.object) {
+        handler.onEndObject(frame.count);
+      } else {
+        handler.onEndArray(frame.count);
+      }
+      if (frames.empty()) {
+        return done();
+      }
+      frames.back().count += 1;
+      if (peek() == ',') {
+        advance();
+      }
+    }
+
+    if (atEnd()) {
+      throw "syntax error: unexpected end of input";
+    }
+    if (frames.back().object) {
+      key();
+    }
+  }
+}
+
+#endif //__JSON_STRUCTURAL_HPP__
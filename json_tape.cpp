@@ -0,0 +1,206 @@
+#include "json_structural.hpp"
+
+// Word layout. Containers: the opening word holds the index just past the
+// closing word in its low 32 bits and the element count (saturated at
+// countLimit) above that; the closing word holds the opening index. Strings
+// and keys: offset of a uint32 length followed by the bytes. Numbers: a tag
+// word followed by the raw long or double bits.
+static constexpr uint64_t countLimit = 0xffffff;
+
+class Json::Tape::Builder {
+public:
+  explicit Builder(Tape &tape) : tape(tape) {}
+
+  void onNull() { append('n', 0); }
+  void onBool(bool value) { append(value ? 't' : 'f', 0); }
+  void onNumber(long value) {
+    append('l', 0);
+    tape.tape.push_back(static_cast<uint64_t>(value));
+  }
+  void onNumber(double value) {
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    append('d', 0);
+    tape.tape.push_back(bits);
+  }
+  void onString(std::string_view value) {
+    append('"', tape.strings.size());
+    auto len = static_cast<uint32_t>(value.size());
+    tape.strings.append(reinterpret_cast<const char *>(&len), sizeof(len));
+    tape.strings.append(value);
+  }
+  void onKey(std::string_view key) { onString(key); }
+  void onStartObject() { open('{'); }
+  void onStartArray() { open('['); }
+  void onEndObject(size_t count) { close('{', '}', count); }
+  void onEndArray(size_t count) { close('[', ']', count); }
+
+private:
+  void append(char tag, uint64_t payload) {
+    tape.tape.push_back((static_cast<uint64_t>(static_cast<unsigned char>(tag)) << 56) | payload);
+  }
+
+  void open(char tag) {
+    starts.push_back(tape.tape.size());
+    append(tag, 0);
+  }
+
+  void close(char openTag, char closeTag, size_t count) {
+    auto start = starts.back();
+    starts.pop_back();
+    append(closeTag, start);
+    auto packed = (std::min<uint64_t>(count, countLimit) << 32) | tape.tape.size();
+    tape.tape[start] = (static_cast<uint64_t>(static_cast<unsigned char>(openTag)) << 56) | packed;
+  }
+
+  Tape &tape;
+  std::vector<size_t> starts;
+};
+
+Json::Tape Json::Tape::parse(std::string_view buff) {
+  std::vector<uint32_t> index;
+  indexStructurals(buff, index);
+  Tape tape;
+  // Roughly one word per index entry; numbers take two.
+  tape.tape.reserve(index.size() + index.size() / 2);
+  Builder builder(tape);
+  if (!Walker<Builder>(buff, index, builder, ParseOptions().maxDepth).run()) {
+    tape.tape.clear();
+    tape.strings.clear();
+  }
+  return tape;
+}
+
+size_t Json::Tape::next(size_t index) const {
+  switch (tag(index)) {
+  case '{': case '[':
+    return payload(index) & 0xffffffff;
+  case 'l': case 'd':
+    return index + 2;
+  default:
+    return index + 1;
+  }
+}
+
+std::string_view Json::Tape::string(size_t index) const {
+  auto offset = payload(index);
+  uint32_t len;
+  std::memcpy(&len, strings.data() + offset, sizeof(len));
+  return std::string_view(strings.data() + offset + sizeof(len), len);
+}
+
+// Every accessor goes through kind(), expect() or numKind(), which reject an
+// invalid Value the way Lazy does.
+Json::Kind Json::Tape::Value::kind() const {
+  if (!tape) {
+    throw "type error: no value";
+  }
+  switch (tape->tag(index)) {
+  case 'n': return Kind::Null;
+  case 't': case 'f': return Kind::Boolean;
+  case 'l': case 'd': return Kind::Number;
+  case '"': return Kind::String;
+  case '[': return Kind::Array;
+  default: return Kind::Object;
+  }
+}
+
+void Json::Tape::Value::expect(char tag, const char *error) const {
+  if (!tape) {
+    throw "type error: no value";
+  }
+  if (tape->tag(index) != tag) {
+    throw error;
+  }
+}
+
+Json::NumberKind Json::Tape::Value::numKind() const {
+  if (!tape) {
+    throw "type error: no value";
+  }
+  switch (tape->tag(index)) {
+  case 'l': return NumberKind::Integer;
+  case 'd': return NumberKind::Floating;
+  default: throw "type error: number";
+  }
+}
+
+bool Json::Tape::Value::asBool() const {
+  if (!isBoolean()) {
+    throw "type error: boolean";
+  }
+  return tape->tag(index) == 't';
+}
+
+long Json::Tape::Value::asInteger() const {
+  expect('l', "type error: integer");
+  return static_cast<long>(tape->tape[index + 1]);
+}
+
+double Json::Tape::Value::asFloating() const {
+  if (numKind() == NumberKind::Integer) {
+    return static_cast<double>(asInteger());
+  }
+  double value;
+  std::memcpy(&value, &tape->tape[index + 1], sizeof(value));
+  return value;
+}
+
+std::string_view Json::Tape::Value::asString() const {
+  expect('"', "type error: string");
+  return tape->string(index);
+}
+
+size_t Json::Tape::Value::size() const {
+  if (!isArray() && !isObject()) {
+    throw "type error: container";
+  }
+  auto count = tape->payload(index) >> 32;
+  if (count < countLimit) {
+    return count;
+  }
+  count = 0;
+  for (auto it = begin(); it != end(); ++it) {
+    count++;
+  }
+  return count;
+}
+
+Json::Tape::Value Json::Tape::Value::operator[](size_t i) const {
+  expect('[', "type error: array");
+  for (auto it = begin(); it != end(); ++it, --i) {
+    if (i == 0) {
+      return *it;
+    }
+  }
+  return Value();
+}
+
+Json::Tape::Value Json::Tape::Value::find(std::string_view key) const {
+  expect('{', "type error: object");
+  for (auto it = begin(); it != end(); ++it) {
+    if (it.key() == key) {
+      return *it;
+    }
+  }
+  return Value();
+}
+
+Json::Tape::Iterator Json::Tape::Value::begin() const {
+  if (!isArray() && !isObject()) {
+    throw "type error: container";
+  }
+  return Iterator(tape, index + 1, isObject());
+}
+
+Json::Tape::Iterator Json::Tape::Value::end() const {
+  if (!isArray() && !isObject()) {
+    throw "type error: container";
+  }
+  return Iterator(tape, tape->next(index) - 1, isObject());
+}
+
+Json::Tape::Iterator &Json::Tape::Iterator::operator++() {
+  index = tape->next(object ? index + 1 : index);
+  return *this;
+}
@@ -4,27 +4,160 @@
 #else
 #include "nlohmann/json.hpp"
 #endif
+#include <cerrno>
+#include <cstdlib>
+#include <fcntl.h>
 #include <iostream>
 #include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
-int main() {
-  std::string line, buff;
-  while (std::getline(std::cin, line)) {
-    buff += "\n";
-    buff += line;
+// The whole input as one contiguous block. Regular files (named on the
+// command line or redirected to stdin) are mapped, anything else is read in
+// large blocks, so the bytes reach the parser without per-line copies.
+class Input {
+public:
+  explicit Input(const char *path) {
+    int fd = path ? open(path, O_RDONLY) : STDIN_FILENO;
+    if (fd < 0) {
+      throw "cannot open input";
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+      size = st.st_size;
+      mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (mapped != MAP_FAILED) {
+        madvise(mapped, size, MADV_SEQUENTIAL);
+      }
+    }
+    if (mapped == MAP_FAILED) {
+      size = 0;
+      char block[1 << 16];
+      ssize_t n;
+      while ((n = read(fd, block, sizeof(block))) != 0) {
+        if (n > 0) {
+          buff.append(block, n);
+        } else if (errno != EINTR) {
+          throw "cannot read input";
+        }
+      }
+    }
+    if (path) {
+      close(fd);
+    }
+  }
+  Input(const Input &) = delete;
+  Input &operator=(const Input &) = delete;
+  ~Input() {
+    if (mapped != MAP_FAILED) {
+      munmap(mapped, size);
+    }
+  }
+
+  std::string_view view() const {
+    if (mapped != MAP_FAILED) {
+      return std::string_view(static_cast<const char *>(mapped), size);
+    }
+    return buff;
+  }
+
+private:
+  void *mapped = MAP_FAILED;
+  size_t size = 0;
+  std::string buff;
+};
+
+#ifdef HOMEBREW
+// Builds the tree through Json::Lazy, walking every container with its
+// iterator and materializing only scalars, so the output can be diffed
+// against a plain parse.
+Json::JsonValue lazyTree(Json::Document &doc, const Json::Lazy &value) {
+  if (!value) {
+    return nullptr;
+  }
+  switch (value.kind()) {
+  case Json::Kind::Array: {
+    auto arr = doc.arena->make<Json::JsonArray>(*doc.arena);
+    for (auto element : value) {
+      arr->push_back(lazyTree(doc, element));
+    }
+    return arr;
+  }
+  case Json::Kind::Object: {
+    auto obj = doc.arena->make<Json::JsonObject>(*doc.arena);
+    for (auto it = value.begin(); it != value.end(); ++it) {
+      obj->set(doc.arena->store(it.key()), lazyTree(doc, *it));
+    }
+    return obj;
+  }
+  default:
+    return value.materialize(doc);
+  }
+}
+#endif
+
+int main(int argc, char **argv) {
+  const char *path = nullptr;
+  // Options of the homebrew parser; accepted but ignored otherwise.
+  [[maybe_unused]] bool sortKeys = false;
+  [[maybe_unused]] bool twoStage = false;
+  [[maybe_unused]] bool lines = false;
+  [[maybe_unused]] bool lazy = false;
+  [[maybe_unused]] unsigned threads = 0;
+  for (int i = 1; i < argc; i++) {
+    std::string_view arg(argv[i]);
+    if (arg == "--sort-keys") {
+      sortKeys = true;
+    } else if (arg == "--two-stage") {
+      twoStage = true;
+    } else if (arg == "--lines") {
+      lines = true;
+    } else if (arg == "--lazy") {
+      lazy = true;
+    } else if (arg.substr(0, 10) == "--threads=") {
+      threads = std::atoi(argv[i] + 10);
+    } else {
+      path = argv[i];
+    }
   }
 #ifdef HOMEBREW
   try {
-    auto [json, _] = Json::parse(buff);
-    Json::print(json);
+    Input input(path);
+    Json::Document doc;
+    Json::ParseOptions parseOptions;
+    parseOptions.engine = twoStage ? Json::Engine::TwoStage : Json::Engine::SinglePass;
+    parseOptions.threads = threads;
+    // The input stays mapped until the document is gone.
+    parseOptions.borrowStrings = true;
+    Json::PrintOptions options;
+    options.sortKeys = sortKeys;
+    if (lines) {
+      Json::Writer out(stdout);
+      for (auto json : Json::parseLines(doc, input.view(), parseOptions)) {
+        Json::write(out, json, 0, false, options);
+        out.put('\n');
+      }
+    } else if (lazy) {
+      Json::print(lazyTree(doc, Json::Lazy(input.view())), 0, false, options);
+    } else {
+      auto [json, _] = Json::parse(doc, input.view(), parseOptions);
+      Json::print(json, 0, false, options);
+    }
   } catch (const char *exp) {
     std::cout << exp << std::endl;
     return 1;
   }
 #else
   try {
-    auto json = nlohmann::json::parse(buff);
+    Input input(path);
+    auto buff = input.view();
+    auto json = nlohmann::json::parse(buff.begin(), buff.end());
     std::cout << json.dump(2);
+  } catch (const char *exp) {
+    std::cout << exp << std::endl;
+    return 1;
   } catch (const nlohmann::json::exception& exp) {
     std::cout << exp.what() << std::endl;
     return 1;